@@ -6,6 +6,7 @@
  */
 
 #include <poppler-config.h>
+#include <jsoncpp/json/json.h>
 
 #include "HTMLRenderer/HTMLRenderer.h"
 #include "Param.h"
@@ -33,11 +34,17 @@ std::unique_ptr<BackgroundRenderer> BackgroundRenderer::getBackgroundRenderer(co
     }
 #endif
 #if ENABLE_SVG
-    if (format == "svg")
+    if ((format == "svg") || (format == "auto"))
     {
         return std::unique_ptr<BackgroundRenderer>(new CairoBackgroundRenderer(html_renderer, param));
     }
 #endif
+#if defined(ENABLE_LIBPNG) || defined(ENABLE_LIBJPEG)
+    if(format == "auto")
+    {
+        return std::unique_ptr<BackgroundRenderer>(new SplashBackgroundRenderer(format, html_renderer, param));
+    }
+#endif
 
     return nullptr;
 }
@@ -46,6 +53,10 @@ std::unique_ptr<BackgroundRenderer> BackgroundRenderer::getFallbackBackgroundRen
 {
     if (param.bg_format == "svg" && param.svg_node_count_limit >= 0)
         return std::unique_ptr<BackgroundRenderer>(new SplashBackgroundRenderer("", html_renderer, param));
+#if ENABLE_SVG
+    if (param.bg_format == "auto")
+        return std::unique_ptr<BackgroundRenderer>(new SplashBackgroundRenderer("auto", html_renderer, param));
+#endif
     return nullptr;
 }
 
@@ -127,4 +138,28 @@ void BackgroundRenderer::proof_update_render(GfxState *state, OutputDev * dev)
     proof_state->setRender(state->getRender());
 }
 
+void BackgroundRenderer::save_image_names(const ImageNameMap & names, Json::Value & out)
+{
+    out = Json::Value(Json::arrayValue);
+    for(auto & p : names)
+    {
+        Json::Value e(Json::arrayValue);
+        for(auto v : p.first)
+            e.append((Json::UInt64)v);
+        e.append(p.second);
+        out.append(e);
+    }
+}
+
+void BackgroundRenderer::restore_image_names(ImageNameMap & names, const Json::Value & in)
+{
+    for(auto & e : in)
+    {
+        ImageKey key;
+        for(size_t i = 0; i < key.size(); ++i)
+            key[i] = e[(int)i].asUInt64();
+        names.insert(std::make_pair(key, e[(int)key.size()].asString()));
+    }
+}
+
 } // namespace pdf2htmlEX
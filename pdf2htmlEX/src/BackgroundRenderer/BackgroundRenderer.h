@@ -11,11 +11,18 @@
 
 #include <string>
 #include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <map>
+#include <array>
+#include <cstdint>
 
 class PDFDoc;
 class GfxState;
 class OutputDev;
 
+namespace Json { class Value; }
+
 namespace pdf2htmlEX {
 
 class Param;
@@ -36,6 +43,12 @@ public:
     //return true on success, false otherwise (e.g. need a fallback)
     virtual bool render_page(PDFDoc * doc, int pageno) = 0;
     virtual void embed_image(int pageno) = 0;
+    // dump a low resolution preview of the page into out, after render_page
+    virtual void embed_preview(std::ostream & out, int pageno) { }
+
+    // state shared by pages, for checkpoints
+    virtual void save_state(Json::Value & state) const { }
+    virtual void restore_state(const Json::Value & state) { }
 
     // for proof output
 protected:
@@ -43,6 +56,13 @@ protected:
     void proof_begin_string(GfxState * state, OutputDev * dev);
     void proof_end_text_object(GfxState * state, OutputDev * dev);
     void proof_update_render(GfxState * state, OutputDev * dev);
+
+    // 128-bit content hash, length of the hashed data, and width << 32 | height for bitmaps
+    typedef std::array<uint64_t, 4> ImageKey;
+    // key -> name of dumped images
+    typedef std::map<ImageKey, std::string> ImageNameMap;
+    static void save_image_names(const ImageNameMap & names, Json::Value & out);
+    static void restore_image_names(ImageNameMap & names, const Json::Value & in);
 private:
     std::unique_ptr<GfxState> proof_state;
 };
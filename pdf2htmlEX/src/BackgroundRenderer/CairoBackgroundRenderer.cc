@@ -6,11 +6,16 @@
 
 #include <string>
 #include <fstream>
+#include <algorithm>
+#include <limits>
 
+#include <jsoncpp/json/json.h>
 
 #include "pdf2htmlEX-config.h"
 
 #include "Base64Stream.h"
+#include "util/hash.h"
+#include "util/path.h"
 
 #if ENABLE_SVG
 
@@ -36,10 +41,15 @@ CairoBackgroundRenderer::~CairoBackgroundRenderer()
 {
     for(auto const& p : bitmaps_ref_count)
     {
-        if (p.second == 0)
+        // unused bitmaps are removed, unless written back for a page from the page cache
+        if ((p.second == 0) && (html_renderer->page_files.count(get_filename(this->build_bitmap_path(p.first))) == 0))
         {
             html_renderer->tmp_files.add(this->build_bitmap_path(p.first));
         }
+        else
+        {
+            html_renderer->stats.add_output_file(this->build_bitmap_path(p.first));
+        }
     }
 }
 
@@ -102,15 +112,148 @@ void CairoBackgroundRenderer::updateRender(GfxState *state)
     CairoOutputDev::updateRender(state);
 }
 
+// device space bounding box of the current path, {xmin, ymin, xmax, ymax}, empty if there are no points
+static void get_path_bbox(GfxState * state, double padding, double * bbox)
+{
+    bbox[0] = bbox[1] = std::numeric_limits<double>::max();
+    bbox[2] = bbox[3] = std::numeric_limits<double>::lowest();
+    auto path = state->getPath();
+    for (int i = 0; i < path->getNumSubpaths(); ++i)
+    {
+        auto subpath = path->getSubpath(i);
+        for (int j = 0; j < subpath->getNumPoints(); ++j)
+        {
+            double x, y;
+            state->transform(subpath->getX(j), subpath->getY(j), &x, &y);
+            bbox[0] = std::min(bbox[0], x - padding);
+            bbox[1] = std::min(bbox[1], y - padding);
+            bbox[2] = std::max(bbox[2], x + padding);
+            bbox[3] = std::max(bbox[3], y + padding);
+        }
+    }
+}
+
+// device space bounding box of an image, which is drawn in the unit square
+static void get_image_bbox(GfxState * state, double * bbox)
+{
+    bbox[0] = bbox[1] = std::numeric_limits<double>::max();
+    bbox[2] = bbox[3] = std::numeric_limits<double>::lowest();
+    for (int i = 0; i < 4; ++i)
+    {
+        double x, y;
+        state->transform(i & 1, i >> 1, &x, &y);
+        bbox[0] = std::min(bbox[0], x);
+        bbox[1] = std::min(bbox[1], y);
+        bbox[2] = std::max(bbox[2], x);
+        bbox[3] = std::max(bbox[3], y);
+    }
+}
+
+void CairoBackgroundRenderer::stroke(GfxState *state)
+{
+    double bbox[4];
+    // joins and caps may go beyond half of the line width
+    get_path_bbox(state, state->getTransformedLineWidth(), bbox);
+    if (count_op(state, bbox))
+        CairoOutputDev::stroke(state);
+}
+
+void CairoBackgroundRenderer::fill(GfxState *state)
+{
+    double bbox[4];
+    get_path_bbox(state, 0, bbox);
+    if (count_op(state, bbox))
+        CairoOutputDev::fill(state);
+}
+
+void CairoBackgroundRenderer::eoFill(GfxState *state)
+{
+    double bbox[4];
+    get_path_bbox(state, 0, bbox);
+    if (count_op(state, bbox))
+        CairoOutputDev::eoFill(state);
+}
+
+void CairoBackgroundRenderer::drawImage(GfxState *state, Object *ref, Stream *str, int width, int height,
+        GfxImageColorMap *colorMap, bool interpolate, const int *maskColors, bool inlineImg)
+{
+    double bbox[4];
+    get_image_bbox(state, bbox);
+    if (count_op(state, bbox))
+        CairoOutputDev::drawImage(state, ref, str, width, height, colorMap, interpolate, maskColors, inlineImg);
+}
+
+void CairoBackgroundRenderer::drawImageMask(GfxState *state, Object *ref, Stream *str, int width, int height,
+        bool invert, bool interpolate, bool inlineImg)
+{
+    double bbox[4];
+    get_image_bbox(state, bbox);
+    if (count_op(state, bbox))
+        CairoOutputDev::drawImageMask(state, ref, str, width, height, invert, interpolate, inlineImg);
+}
+
+/*
+ * Each path or image that is not clipped out produces at least one node in the svg,
+ * so the page can be given up as soon as there are too many of them,
+ * without waiting for cairo to generate the svg.
+ * Ops outside of the clip are dropped by cairo, they are drawn but not counted.
+ */
+bool CairoBackgroundRenderer::count_op(GfxState * state, const double * bbox)
+{
+    if (page_svg_too_complex)
+        return false;
+
+    double xmin, ymin, xmax, ymax;
+    state->getClipBBox(&xmin, &ymin, &xmax, &ymax);
+    if ((bbox[0] > xmax) || (bbox[2] < xmin) || (bbox[1] > ymax) || (bbox[3] < ymin))
+        return true;
+
+    ++page_op_count;
+    if ((param.svg_node_count_limit >= 0) && (page_op_count > param.svg_node_count_limit))
+    {
+        page_svg_too_complex = true;
+        return false;
+    }
+    return true;
+}
+
 void CairoBackgroundRenderer::init(PDFDoc * doc)
 {
     startDoc(doc);
 }
 
+void CairoBackgroundRenderer::save_state(Json::Value & state) const
+{
+    save_image_names(dumped_images, state["images"]);
+
+    Json::Value & bitmaps = state["bitmaps"];
+    bitmaps = Json::Value(Json::arrayValue);
+    for(auto & p : bitmaps_ref_count)
+    {
+        Json::Value e(Json::arrayValue);
+        e.append(p.first);
+        e.append(p.second);
+        bitmaps.append(e);
+    }
+}
+
+void CairoBackgroundRenderer::restore_state(const Json::Value & state)
+{
+    restore_image_names(dumped_images, state["images"]);
+
+    for(auto & e : state["bitmaps"])
+        bitmaps_ref_count[e[0].asInt()] = e[1].asInt();
+}
+
 static bool annot_cb(Annot *, void * pflag) {
     return (*((bool*)pflag)) ? true : false;
 };
 
+bool CairoBackgroundRenderer::abort_check_cb(void * data)
+{
+    return static_cast<CairoBackgroundRenderer*>(data)->page_svg_too_complex;
+}
+
 bool CairoBackgroundRenderer::render_page(PDFDoc * doc, int pageno)
 {
     drawn_char_count = 0;
@@ -130,11 +273,18 @@ bool CairoBackgroundRenderer::render_page(PDFDoc * doc, int pageno)
     if (doc->getPageRotate(pageno) == 90 || doc->getPageRotate(pageno) == 270)
         std::swap(page_height, page_width);
 
-    string fn = (char*)html_renderer->str_fmt("%s/bg%x.svg", (param.embed_image ? param.tmp_dir : param.dest_dir).c_str(), pageno);
-    if(param.embed_image)
-        html_renderer->tmp_files.add(fn);
-
-    surface = cairo_svg_surface_create(fn.c_str(), page_width * param.actual_dpi / DEFAULT_DPI, page_height * param.actual_dpi / DEFAULT_DPI);
+    // the svg document is kept in memory, and checked as it is written by cairo
+    page_svg.clear();
+    page_svg_node_count = 0;
+    page_op_count = 0;
+    page_svg_too_complex = false;
+    // in auto mode, fall back to bitmap if the svg is likely to be larger than a compressed bitmap
+    // which assumes about 0.5 byte per pixel
+    page_svg_size_limit = -1;
+    if (param.bg_format == "auto")
+        page_svg_size_limit = (long long)((page_width * param.actual_dpi / DEFAULT_DPI) * (page_height * param.actual_dpi / DEFAULT_DPI) / 2);
+
+    surface = cairo_svg_surface_create_for_stream(write_svg, this, page_width * param.actual_dpi / DEFAULT_DPI, page_height * param.actual_dpi / DEFAULT_DPI);
     cairo_svg_surface_restrict_to_version(surface, CAIRO_SVG_VERSION_1_2);
     cairo_surface_set_fallback_resolution(surface, param.actual_dpi, param.actual_dpi);
 
@@ -149,7 +299,7 @@ bool CairoBackgroundRenderer::render_page(PDFDoc * doc, int pageno)
             (!(param.use_cropbox)),
             false,
             false,
-            nullptr, nullptr, &annot_cb, &process_annotation);
+            &abort_check_cb, this, &annot_cb, &process_annotation);
 
     setCairo(nullptr);
 
@@ -165,32 +315,50 @@ bool CairoBackgroundRenderer::render_page(PDFDoc * doc, int pageno)
         auto status = cairo_surface_status(surface);
         cairo_surface_destroy(surface);
         surface = nullptr;
+        // fall back to bitmap_renderer, rendering or writing has been aborted
+        if(page_svg_too_complex)
+        {
+            page_svg.clear();
+            return false;
+        }
         if(status)
             throw string("Error in cairo: ") + cairo_status_to_string(status);
     }
 
-    //check node count in the svg file, fall back to bitmap_renderer if necessary.
-    if (param.svg_node_count_limit >= 0)
+    // identical pages (e.g. slide templates) share the same svg file
+    ContentHash128 content_hash;
+    content_hash.update(page_svg.data(), page_svg.size());
+    ImageKey key = {{ content_hash.get_high(), content_hash.get_low(), content_hash.get_length(), 0 }};
+    auto iter = dumped_images.find(key);
+    if(iter != dumped_images.end())
+    {
+        page_image_name = iter->second;
+    }
+    else
     {
-        int n = 0;
-        char c;
-        ifstream svgfile(fn);
-        //count of '<' in the file should be an approximation of node count.
-        while(svgfile >> c)
+        page_image_name = (char*)html_renderer->str_fmt("bg%x.svg", pageno);
+        dumped_images.insert(std::make_pair(key, page_image_name));
+
+        if(!param.embed_image)
         {
-            if (c == '<')
-                ++n;
-            if (n > param.svg_node_count_limit)
-            {
-                html_renderer->tmp_files.add(fn);
-                return false;
-            }
+            string fn = param.dest_dir + "/" + page_image_name;
+            ofstream svgfile(fn, ofstream::binary);
+            if(!svgfile)
+                throw string("Cannot open file for background image ") + fn;
+            svgfile << page_svg;
+            html_renderer->stats.add_output_file(fn);
         }
     }
 
+    if(!param.embed_image)
+        html_renderer->add_page_file(param.dest_dir + "/" + page_image_name);
+
     // the svg file is actually used, so add its bitmaps' ref count.
     for (auto id : bitmaps_in_current_page)
+    {
         ++bitmaps_ref_count[id];
+        html_renderer->add_page_file(build_bitmap_path(id));
+    }
 
     return true;
 }
@@ -207,7 +375,7 @@ void CairoBackgroundRenderer::embed_image(int pageno)
     //   http://stackoverflow.com/questions/4476526/do-i-use-img-object-or-embed-for-svg-files
 
     if (param.svg_embed_bitmap || bitmaps_in_current_page.empty())
-        f_page << "<img";
+        f_page << "<img decoding=\"async\" loading=\"lazy\"";
     else
         f_page << "<embed";
 
@@ -216,19 +384,39 @@ void CairoBackgroundRenderer::embed_image(int pageno)
 
     if(param.embed_image)
     {
-        auto path = html_renderer->str_fmt("%s/bg%x.svg", param.tmp_dir.c_str(), pageno);
-        ifstream fin((char*)path, ifstream::binary);
-        if(!fin)
-            throw string("Cannot read background image ") + (char*)path;
-        f_page << "data:image/svg+xml;base64," << Base64Stream(fin);
+        f_page << "data:image/svg+xml;base64," << Base64Stream(page_svg);
     }
     else
     {
-        f_page << (char*)html_renderer->str_fmt("bg%x.svg", pageno);
+        f_page << page_image_name;
     }
     f_page << "\"/>";
 }
 
+cairo_status_t CairoBackgroundRenderer::write_svg(void * closure, const unsigned char * data, unsigned int length)
+{
+    auto * renderer = static_cast<CairoBackgroundRenderer*>(closure);
+    auto & param = renderer->param;
+
+    // the page has been given up during rendering
+    if(renderer->page_svg_too_complex)
+        return CAIRO_STATUS_WRITE_ERROR;
+
+    //count of '<' in the file should be an approximation of node count.
+    renderer->page_svg_node_count += std::count(data, data + length, '<');
+    renderer->page_svg.append((const char *)data, length);
+
+    if(((param.svg_node_count_limit >= 0) && (renderer->page_svg_node_count > param.svg_node_count_limit))
+            || ((renderer->page_svg_size_limit >= 0) && ((long long)renderer->page_svg.size() > renderer->page_svg_size_limit)))
+    {
+        // stop cairo from writing any further
+        renderer->page_svg_too_complex = true;
+        return CAIRO_STATUS_WRITE_ERROR;
+    }
+
+    return CAIRO_STATUS_SUCCESS;
+}
+
 string CairoBackgroundRenderer::build_bitmap_path(int id)
 {
     // "o" for "PDF Object"
@@ -15,6 +15,7 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <cstdint>
 
 #include "pdf2htmlEX-config.h"
 
@@ -34,6 +35,8 @@ public:
   virtual void init(PDFDoc * doc);
   virtual bool render_page(PDFDoc * doc, int pageno);
   virtual void embed_image(int pageno);
+  virtual void save_state(Json::Value & state) const;
+  virtual void restore_state(const Json::Value & state);
 
   // Does this device use beginType3Char/endType3Char?  Otherwise,
   // text in Type 3 fonts will be drawn with drawChar/drawString.
@@ -44,6 +47,15 @@ public:
       double originX, double originY,
       CharCode code, int nBytes, const Unicode *u, int uLen);
 
+  // count paths and images, to give up over-complex pages early
+  virtual void stroke(GfxState *state);
+  virtual void fill(GfxState *state);
+  virtual void eoFill(GfxState *state);
+  virtual void drawImage(GfxState *state, Object *ref, Stream *str, int width, int height,
+      GfxImageColorMap *colorMap, bool interpolate, const int *maskColors, bool inlineImg);
+  virtual void drawImageMask(GfxState *state, Object *ref, Stream *str, int width, int height,
+      bool invert, bool interpolate, bool inlineImg);
+
   //for proof
   void beginTextObject(GfxState *state);
   void beginString(GfxState *state, const GooString * str);
@@ -68,6 +80,21 @@ private:
   // id of bitmaps' stream used by current page
   std::vector<int> bitmaps_in_current_page;
   int drawn_char_count;
+  // content hash -> name of the svg file
+  ImageNameMap dumped_images;
+  // name of the svg file used by current page
+  std::string page_image_name;
+  // the svg document of current page
+  std::string page_svg;
+  long long page_svg_node_count;
+  long long page_op_count;
+  long long page_svg_size_limit;
+  bool page_svg_too_complex;
+  // count a path or an image with the device space bbox {xmin, ymin, xmax, ymax}, return false if the page has been given up
+  bool count_op(GfxState * state, const double * bbox);
+  static bool abort_check_cb(void * data);
+  // cairo write function for the svg document of current page
+  static cairo_status_t write_svg(void * closure, const unsigned char * data, unsigned int length);
 };
 
 }
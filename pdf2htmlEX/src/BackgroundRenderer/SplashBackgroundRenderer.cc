@@ -7,15 +7,31 @@
 #include <fstream>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_set>
+#include <unordered_map>
 
 #include <poppler-config.h>
+#include <jsoncpp/json/json.h>
 #include <PDFDoc.h>
 #include <goo/ImgWriter.h>
-#include <goo/PNGWriter.h>
 #include <goo/JpegWriter.h>
+#include <splash/Splash.h>
+#include <splash/SplashClip.h>
+
+#ifdef ENABLE_LIBPNG
+#include <png.h>
+#endif
 
 #include "Base64Stream.h"
 #include "util/const.h"
+#include "util/hash.h"
 
 #include "SplashBackgroundRenderer.h"
 
@@ -23,18 +39,31 @@ namespace pdf2htmlEX {
 
 using std::string;
 using std::ifstream;
+using std::ofstream;
 using std::vector;
 using std::unique_ptr;
 
 const SplashColor SplashBackgroundRenderer::white = {255,255,255};
+// painted under passthrough images, content drawn over them later is unlikely to have exactly this color
+const SplashColor SplashBackgroundRenderer::passthrough_marker = {1,254,3};
 
 SplashBackgroundRenderer::SplashBackgroundRenderer(const string & imgFormat, HTMLRenderer * html_renderer, const Param & param)
     : SplashOutputDev(splashModeRGB8, 4, false, (SplashColorPtr)(&white), true, splashThinLineSolid) // DCRH: Make thin line mode = solid
     , html_renderer(html_renderer)
     , param(param)
     , format(imgFormat)
+    , drawn_char_count(0)
+    , page_bitmap(nullptr)
+    , passthrough_disabled(false)
 {
     bool supported = false;
+#if defined(ENABLE_LIBPNG) && defined(ENABLE_LIBJPEG)
+    supported = supported || format == "auto";
+#else
+    // only one bitmap format is built in, there is nothing to choose
+    if (format == "auto")
+        format = "";
+#endif
 #ifdef ENABLE_LIBPNG
     if (format.empty())
         format = "png";
@@ -52,13 +81,163 @@ SplashBackgroundRenderer::SplashBackgroundRenderer(const string & imgFormat, HTM
 }
 
 /*
- * SplashOutputDev::startPage would paint the whole page with the background color
- * And thus have modified region set to the whole page area
- * We do not want that.
+ * SplashOutputDev::startPage keeps the bitmap of the previous page if the size is unchanged,
+ * and paints the whole page with the background color.
+ * Modified region is no longer tracked by poppler, see get_content_bbox and is_blank instead.
  */
 void SplashBackgroundRenderer::startPage(int pageNum, GfxState *state, XRef *xrefA)
 {
     SplashOutputDev::startPage(pageNum, state, xrefA);
+    page_bitmap = getBitmap();
+}
+
+void SplashBackgroundRenderer::drawImage(GfxState *state, Object *ref, Stream *str, int width, int height,
+        GfxImageColorMap *colorMap, bool interpolate, const int *maskColors, bool inlineImg)
+{
+    if (param.bg_jpeg_passthrough && !passthrough_disabled && (maskColors == nullptr) && (!inlineImg)
+            && passthrough_jpeg(state, ref, str))
+        return;
+    SplashOutputDev::drawImage(state, ref, str, width, height, colorMap, interpolate, maskColors, inlineImg);
+}
+
+/*
+ * Try to emit a JPEG image as it is, instead of rasterizing it into the bitmap
+ *
+ * The image will be put above the bitmap, so it must be opaque, axis-aligned and not clipped.
+ * The area under the image is painted with passthrough_marker, such that content drawn over it later
+ * can be detected, see render_page
+ * Files are written only after the page is accepted, see commit_passthrough_images
+ */
+bool SplashBackgroundRenderer::passthrough_jpeg(GfxState * state, Object * ref, Stream * str)
+{
+    if ((str->getKind() != strDCT) || (ref == nullptr) || (!ref->isRef()))
+        return false;
+
+    // same as CairoBackgroundRenderer::setMimeData, only rgb or gray jpeg without /Decode array are safe
+    Object obj = str->getDict()->lookup("ColorSpace");
+    if (!obj.isName() || (strcmp(obj.getName(), "DeviceRGB") && strcmp(obj.getName(), "DeviceGray")))
+        return false;
+    obj = str->getDict()->lookup("Decode");
+    if (obj.isArray())
+        return false;
+
+    // not in a transparency group, and painted opaquely
+    if ((getBitmap() != page_bitmap) || (state->getFillOpacity() != 1) || (state->getBlendMode() != gfxBlendNormal))
+        return false;
+
+    // neither rotated nor flipped
+    const double * ctm = state->getCTM();
+    if ((ctm[1] != 0) || (ctm[2] != 0) || (ctm[0] <= 0) || (ctm[3] >= 0))
+        return false;
+
+    PassthroughImage image;
+    image.x1 = ctm[4];
+    image.x2 = ctm[4] + ctm[0];
+    image.y1 = ctm[5] + ctm[3];
+    image.y2 = ctm[5];
+
+    SplashClip * clip = getSplash()->getClip();
+    if ((clip->getNumPaths() > 0)
+            || (image.x1 < clip->getXMin()) || (image.x2 > clip->getXMax())
+            || (image.y1 < clip->getYMin()) || (image.y2 > clip->getYMax()))
+        return false;
+
+    image.id = ref->getRef().num;
+    if (jpeg_data.find(image.id) == jpeg_data.end())
+    {
+        string data;
+        Stream * raw_str = str->getNextStream();
+        raw_str->reset();
+        char buf[1024];
+        int len;
+        while ((len = raw_str->doGetChars(sizeof(buf), (unsigned char*)buf)) > 0)
+            data.append(buf, len);
+        raw_str->close();
+        jpeg_data.insert(std::make_pair(image.id, std::move(data)));
+    }
+
+    int x1, y1, x2, y2;
+    if (get_covered_pixels(image, x1, y1, x2, y2))
+        fill_region(passthrough_marker, x1, y1, x2, y2);
+
+    passthrough_images.push_back(image);
+    return true;
+}
+
+/*
+ * Called when the passthrough images of the page are kept
+ * Write the jpeg files and erase the area under the images, which is hidden anyway
+ */
+void SplashBackgroundRenderer::commit_passthrough_images(void)
+{
+    for (auto & image : passthrough_images)
+    {
+        int x1, y1, x2, y2;
+        if (get_covered_pixels(image, x1, y1, x2, y2))
+            fill_region(white, x1, y1, x2, y2);
+
+        if (param.embed_image)
+            continue;
+
+        // same name as in CairoBackgroundRenderer
+        string fn = (char*)html_renderer->str_fmt("%s/o%d.jpg", param.dest_dir.c_str(), image.id);
+        // the data is dropped once the file is written
+        string & data = jpeg_data[image.id];
+        if (!data.empty())
+        {
+            ofstream imgfile(fn, ofstream::binary);
+            if (!imgfile)
+                throw string("Cannot open file for background image ") + fn;
+            imgfile << data;
+            data.clear();
+            html_renderer->stats.add_output_file(fn);
+        }
+        html_renderer->add_page_file(fn);
+    }
+}
+
+void SplashBackgroundRenderer::fill_region(const SplashColor color, int x1, int y1, int x2, int y2)
+{
+    auto * bitmap = getBitmap();
+    int row_size = bitmap->getRowSize();
+    unsigned char * row = bitmap->getDataPtr() + y1 * row_size + x1 * 3;
+    for (int y = y1; y <= y2; ++y, row += row_size)
+    {
+        unsigned char * p = row;
+        for (int x = x1; x <= x2; ++x, p += 3)
+        {
+            p[0] = color[0];
+            p[1] = color[1];
+            p[2] = color[2];
+        }
+    }
+}
+
+bool SplashBackgroundRenderer::is_filled_with(const SplashColor color, int x1, int y1, int x2, int y2)
+{
+    auto * bitmap = getBitmap();
+    int row_size = bitmap->getRowSize();
+    const unsigned char * row = bitmap->getDataPtr() + y1 * row_size + x1 * 3;
+    for (int y = y1; y <= y2; ++y, row += row_size)
+    {
+        const unsigned char * p = row;
+        for (int x = x1; x <= x2; ++x, p += 3)
+        {
+            if ((p[0] != color[0]) || (p[1] != color[1]) || (p[2] != color[2]))
+                return false;
+        }
+    }
+    return true;
+}
+
+// pixels fully covered by the image, return false if there are none
+bool SplashBackgroundRenderer::get_covered_pixels(const PassthroughImage & image, int & x1, int & y1, int & x2, int & y2)
+{
+    x1 = std::max(0, (int)std::ceil(image.x1));
+    y1 = std::max(0, (int)std::ceil(image.y1));
+    x2 = std::min(getBitmapWidth(), (int)std::floor(image.x2)) - 1;
+    y2 = std::min(getBitmapHeight(), (int)std::floor(image.y2)) - 1;
+    return (x1 <= x2) && (y1 <= y2);
 }
 
 void SplashBackgroundRenderer::drawChar(GfxState *state, double x, double y,
@@ -111,139 +290,688 @@ static bool annot_cb(Annot *, void * pflag) {
 
 bool SplashBackgroundRenderer::render_page(PDFDoc * doc, int pageno)
 {
-    drawn_char_count = 0;
-    bool process_annotation = param.process_annotation;
+    passthrough_disabled = false;
+    // at most twice, without passthrough jpeg images for the second time
+    while(true)
+    {
+        drawn_char_count = 0;
+        passthrough_images.clear();
+        bool process_annotation = param.process_annotation;
+
+        doc->displayPage(this, pageno, param.actual_dpi, param.actual_dpi,
+                0, 
+                (!(param.use_cropbox)),
+                false, false,
+                nullptr, nullptr, &annot_cb, &process_annotation);
+
+        if(passthrough_disabled)
+            break;
+
+        // something has been drawn over the passthrough images, which would be hidden by them
+        // images drawn over each other leave the same marker, which is fine as they are stacked in order
+        bool covered = false;
+        for(auto & image : passthrough_images)
+        {
+            int x1, y1, x2, y2;
+            if(get_covered_pixels(image, x1, y1, x2, y2) && !is_filled_with(passthrough_marker, x1, y1, x2, y2))
+            {
+                covered = true;
+                break;
+            }
+        }
+        if(!covered)
+        {
+            commit_passthrough_images();
+            break;
+        }
 
-    doc->displayPage(this, pageno, param.actual_dpi, param.actual_dpi,
-            0, 
-            (!(param.use_cropbox)),
-            false, false,
-            nullptr, nullptr, &annot_cb, &process_annotation);
+        passthrough_disabled = true;
+    }
+    return true;
+}
+
+/*
+ * Check if all pixels in the row are white
+ * Bytes are combined word by word, which is cheaper than checking them one by one
+ */
+static bool is_white_row(const unsigned char * p, int len)
+{
+    uint64_t acc = ~(uint64_t)0;
+    int i = 0;
+    for(; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        acc &= w;
+    }
+    unsigned char tail = 0xff;
+    for(; i < len; ++i)
+        tail &= p[i];
+    return (acc == ~(uint64_t)0) && (tail == 0xff);
+}
+
+bool SplashBackgroundRenderer::is_blank(int x1, int y1, int x2, int y2)
+{
+    auto * bitmap = getBitmap();
+    assert(bitmap->getMode() == splashModeRGB8);
+    // the paper color is white
+    assert((white[0] == 255) && (white[1] == 255) && (white[2] == 255));
+
+    int row_size = bitmap->getRowSize();
+    const unsigned char * p = bitmap->getDataPtr() + y1 * row_size + x1 * 3;
+    for(int y = y1; y <= y2; ++y, p += row_size)
+    {
+        if(!is_white_row(p, (x2 - x1 + 1) * 3))
+            return false;
+    }
+    return true;
+}
+
+static inline bool is_white_word(const unsigned char * p)
+{
+    uint64_t w;
+    memcpy(&w, p, 8);
+    return w == ~(uint64_t)0;
+}
+
+bool SplashBackgroundRenderer::get_content_bbox(int & xmin, int & ymin, int & xmax, int & ymax)
+{
+    auto * bitmap = getBitmap();
+    assert(bitmap->getMode() == splashModeRGB8);
+
+    int width = bitmap->getWidth();
+    int height = bitmap->getHeight();
+    int row_size = bitmap->getRowSize();
+    int row_len = width * 3;
+    const unsigned char * data = bitmap->getDataPtr();
+
+    ymin = 0;
+    while((ymin < height) && is_white_row(data + ymin * row_size, row_len))
+        ++ymin;
+    if(ymin == height)
+        return false;
+
+    ymax = height - 1;
+    while(is_white_row(data + ymax * row_size, row_len))
+        --ymax;
+
+    // the first and the last non-white bytes among all rows
+    // only the part outside of the current range needs to be checked for each row
+    int left = row_len, right = -1;
+    for(int y = ymin; y <= ymax; ++y)
+    {
+        const unsigned char * p = data + y * row_size;
+
+        int i = 0;
+        while((i + 8 <= left) && is_white_word(p + i))
+            i += 8;
+        while((i < left) && (p[i] == 0xff))
+            ++i;
+        left = i;
+
+        int j = row_len - 1;
+        while((j - 8 >= right) && is_white_word(p + j - 7))
+            j -= 8;
+        while((j > right) && (p[j] == 0xff))
+            --j;
+        right = j;
+    }
+
+    xmin = left / 3;
+    xmax = right / 3;
     return true;
 }
 
 void SplashBackgroundRenderer::embed_image(int pageno)
 {
-    // xmin->xmax is top->bottom
-    int xmin, xmax, ymin, ymax;
-// poppler-0.84.0 hack to recover from the removal of *ModRegion tracking 
-//
-	auto * bitmap = getBitmap();
-	xmin = 0;
-	xmax = bitmap->getWidth();
-	ymin = 0;
-	ymax = bitmap->getHeight();
-//
-// end of hack
-	
-    // dump the background image only when it is not empty
-    if((xmin <= xmax) && (ymin <= ymax))
+    auto * bitmap = getBitmap();
+    int width = bitmap->getWidth();
+    int height = bitmap->getHeight();
+
+    if(param.bg_tile_size > 0)
     {
+        // split the page into tiles, blank ones are skipped
+        int tile_size = param.bg_tile_size;
+        for(int y1 = 0, ty = 0; y1 < height; y1 += tile_size, ++ty)
         {
-            auto fn = html_renderer->str_fmt("%s/bg%x.%s", (param.embed_image ? param.tmp_dir : param.dest_dir).c_str(), pageno, format.c_str());
-            if(param.embed_image)
-                html_renderer->tmp_files.add((char*)fn);
-
-            dump_image((char*)fn, xmin, ymin, xmax, ymax);
+            int y2 = std::min(y1 + tile_size, height) - 1;
+            for(int x1 = 0, tx = 0; x1 < width; x1 += tile_size, ++tx)
+            {
+                int x2 = std::min(x1 + tile_size, width) - 1;
+                if(is_blank(x1, y1, x2, y2))
+                    continue;
+
+                string img_format = choose_format(x1, y1, x2, y2);
+                string name = (char*)html_renderer->str_fmt("bg%x-%x-%x.%s", pageno, tx, ty, img_format.c_str());
+                embed_image_region(name, img_format, x1, y1, x2, y2);
+            }
+        }
+    }
+    else
+    {
+        // only dump the part with actual content, nothing for blank pages
+        int xmin, ymin, xmax, ymax;
+        if(get_content_bbox(xmin, ymin, xmax, ymax))
+        {
+            string img_format = choose_format(xmin, ymin, xmax, ymax);
+            string name = (char*)html_renderer->str_fmt("bg%x.%s", pageno, img_format.c_str());
+            embed_image_region(name, img_format, xmin, ymin, xmax, ymax);
         }
+    }
 
+    // passthrough jpeg images are above the bitmap, in their original order
+    for(auto & image : passthrough_images)
+    {
         double h_scale = html_renderer->text_zoom_factor() * DEFAULT_DPI / param.actual_dpi;
         double v_scale = html_renderer->text_zoom_factor() * DEFAULT_DPI / param.actual_dpi;
 
         auto & f_page = *(html_renderer->f_curpage);
         auto & all_manager = html_renderer->all_manager;
-        
+
         f_page << "<img class=\"" << CSS::BACKGROUND_IMAGE_CN 
-            << " " << CSS::LEFT_CN      << all_manager.left.install(((double)xmin) * h_scale)
-            << " " << CSS::BOTTOM_CN    << all_manager.bottom.install(((double)getBitmapHeight() - 1 - ymax) * v_scale)
-            << " " << CSS::WIDTH_CN     << all_manager.width.install(((double)(xmax - xmin + 1)) * h_scale)
-            << " " << CSS::HEIGHT_CN    << all_manager.height.install(((double)(ymax - ymin + 1)) * v_scale)
-            << "\" alt=\"\" src=\"";
+            << " " << CSS::LEFT_CN      << all_manager.left.install(image.x1 * h_scale)
+            << " " << CSS::BOTTOM_CN    << all_manager.bottom.install(((double)getBitmapHeight() - image.y2) * v_scale)
+            << " " << CSS::WIDTH_CN     << all_manager.width.install((image.x2 - image.x1) * h_scale)
+            << " " << CSS::HEIGHT_CN    << all_manager.height.install((image.y2 - image.y1) * v_scale)
+            << "\" alt=\"\" decoding=\"async\" loading=\"lazy\" src=\"";
 
         if(param.embed_image)
+            f_page << "data:image/jpeg;base64," << Base64Stream(jpeg_data[image.id]);
+        else
+            f_page << (char*)html_renderer->str_fmt("o%d.jpg", image.id);
+        f_page << "\"/>";
+    }
+}
+
+/*
+ * Choose the image format for a region when the format is "auto"
+ *
+ * Photographic images (many colors, smooth transitions) are saved as jpg,
+ * while line art, diagrams and text (few colors, or sharp edges) are saved as png,
+ * which keeps them lossless and is usually smaller for such content.
+ */
+string SplashBackgroundRenderer::choose_format(int x1, int y1, int x2, int y2)
+{
+    if(format != "auto")
+        return format;
+
+    auto * bitmap = getBitmap();
+    int row_size = bitmap->getRowSize();
+    const unsigned char * data = bitmap->getDataPtr();
+
+    // sample about 64K pixels at most
+    const int MAX_COLOR_COUNT = 256;
+    long long pixel_count = (long long)(x2 - x1 + 1) * (y2 - y1 + 1);
+    int step = std::max(1, (int)std::sqrt((double)pixel_count / 65536));
+
+    std::unordered_set<uint32_t> colors;
+    long long changes = 0, sharp_changes = 0;
+    for(int y = y1; y <= y2; y += step)
+    {
+        const unsigned char * row = data + y * row_size;
+        for(int x = x1; x + 1 <= x2; x += step)
         {
-            auto path = html_renderer->str_fmt("%s/bg%x.%s", param.tmp_dir.c_str(), pageno, format.c_str());
-            ifstream fin((char*)path, ifstream::binary);
-            if(!fin)
-                throw string("Cannot read background image ") + (char*)path;
+            const unsigned char * p = row + x * 3;
+            if((int)colors.size() <= MAX_COLOR_COUNT)
+                colors.insert((p[0] << 16) | (p[1] << 8) | p[2]);
+
+            // compare with the right neighbor
+            int diff = std::abs(p[0] - p[3]) + std::abs(p[1] - p[4]) + std::abs(p[2] - p[5]);
+            if(diff > 0)
+            {
+                ++changes;
+                if(diff > 96)
+                    ++sharp_changes;
+            }
+        }
+    }
+
+    if((int)colors.size() <= MAX_COLOR_COUNT)
+        return "png";
+    // most color changes are sharp edges
+    if(sharp_changes * 4 > changes)
+        return "png";
+    return "jpg";
+}
+
+BackgroundRenderer::ImageKey SplashBackgroundRenderer::hash_image(const string & img_format, int x1, int y1, int x2, int y2)
+{
+    auto * bitmap = getBitmap();
+    int row_size = bitmap->getRowSize();
+    int width = x2 - x1 + 1;
+    int height = y2 - y1 + 1;
 
-            auto iter = FORMAT_MIME_TYPE_MAP.find(format);
-            if(iter == FORMAT_MIME_TYPE_MAP.end())
-                throw string("Image format not supported: ") + format;
+    // strong enough to be trusted, such that a repeated image is never encoded again
+    ContentHash128 content_hash;
+    content_hash.update(img_format);
+    const unsigned char * p = bitmap->getDataPtr() + y1 * row_size + x1 * 3;
+    for(int y = y1; y <= y2; ++y, p += row_size)
+        content_hash.update(p, width * 3);
+
+    // images of different shapes never match
+    ImageKey key = {{ content_hash.get_high(), content_hash.get_low(), content_hash.get_length(),
+        (((uint64_t)width) << 32) | (uint64_t)height }};
+    return key;
+}
 
-            string mime_type = iter->second;
-            f_page << "data:" << mime_type << ";base64," << Base64Stream(fin);
+/*
+ * Shrink the RGB image by factor with a box filter
+ * The last row/column is repeated for sizes that are not multiples of factor
+ */
+static void downsample(unsigned char * const * rows, int width, int height, int factor, vector<unsigned char> & out)
+{
+    int out_width = (width + factor - 1) / factor;
+    int out_height = (height + factor - 1) / factor;
+    int area = factor * factor;
+    out.resize((size_t)out_width * out_height * 3);
+    vector<int> sum(out_width * 3);
+    unsigned char * q = out.data();
+    for(int y = 0; y < out_height; ++y)
+    {
+        std::fill(sum.begin(), sum.end(), 0);
+        for(int dy = 0; dy < factor; ++dy)
+        {
+            const unsigned char * r = rows[std::min(y * factor + dy, height - 1)];
+            for(int x = 0; x < out_width; ++x)
+            {
+                for(int dx = 0; dx < factor; ++dx)
+                {
+                    const unsigned char * p = r + std::min(x * factor + dx, width - 1) * 3;
+                    sum[x * 3] += p[0];
+                    sum[x * 3 + 1] += p[1];
+                    sum[x * 3 + 2] += p[2];
+                }
+            }
         }
+        for(int i = 0; i < out_width * 3; ++i)
+            *(q++) = (sum[i] + area / 2) / area;
+    }
+}
+
+void SplashBackgroundRenderer::embed_image_region(string name, const string & img_format, int xmin, int ymin, int xmax, int ymax)
+{
+    // xmin->xmax is top->bottom
+
+    // identical images (e.g. letterheads) are dumped only once
+    auto key = hash_image(img_format, xmin, ymin, xmax, ymax);
+    auto iter = dumped_images.find(key);
+    bool dumped = (iter != dumped_images.end());
+    if(dumped)
+        name = iter->second;
+    else
+        dumped_images.insert(std::make_pair(key, name));
+
+    string path = (param.embed_image ? param.tmp_dir : param.dest_dir) + "/" + name;
+    if(!dumped)
+    {
+        if(param.embed_image)
+            html_renderer->tmp_files.add(path);
         else
+            html_renderer->stats.add_output_file(path);
+
+        dump_image(path.c_str(), img_format, xmin, ymin, xmax, ymax);
+    }
+    if(!param.embed_image)
+        html_renderer->add_page_file(path);
+
+    // smaller versions for srcset, each is half the size of the previous one
+    string srcset;
+    if((param.bg_srcset_levels > 0) && (!param.embed_image))
+    {
+        int width = xmax - xmin + 1;
+        int height = ymax - ymin + 1;
+        srcset = name + " " + std::to_string(width) + "w";
+
+        vector<unsigned char> buf;
+        vector<unsigned char*> rows;
+        if(!dumped)
+            rows = get_rows(xmin, ymin, xmax, ymax);
+
+        string base_name = name.substr(0, name.rfind('.'));
+        for(int level = 1; (level <= param.bg_srcset_levels) && (width > 1) && (height > 1); ++level)
         {
-            f_page << (char*)html_renderer->str_fmt("bg%x.%s", pageno, format.c_str());
+            string level_name = base_name + "-s" + std::to_string(level) + "." + img_format;
+            string level_path = param.dest_dir + "/" + level_name;
+            if(!dumped)
+            {
+                vector<unsigned char> half_buf;
+                downsample(rows.data(), width, height, 2, half_buf);
+                buf.swap(half_buf);
+            }
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+            if(!dumped)
+            {
+                rows.clear();
+                for(int y = 0; y < height; ++y)
+                    rows.push_back(buf.data() + (size_t)y * width * 3);
+                dump_rows(level_path.c_str(), img_format, width, height, rows.data());
+                html_renderer->stats.add_output_file(level_path);
+            }
+            html_renderer->add_page_file(level_path);
+            srcset += ", " + level_name + " " + std::to_string(width) + "w";
         }
-        f_page << "\"/>";
     }
+
+    double h_scale = html_renderer->text_zoom_factor() * DEFAULT_DPI / param.actual_dpi;
+    double v_scale = html_renderer->text_zoom_factor() * DEFAULT_DPI / param.actual_dpi;
+
+    auto & f_page = *(html_renderer->f_curpage);
+    auto & all_manager = html_renderer->all_manager;
+
+    f_page << "<img class=\"" << CSS::BACKGROUND_IMAGE_CN 
+        << " " << CSS::LEFT_CN      << all_manager.left.install(((double)xmin) * h_scale)
+        << " " << CSS::BOTTOM_CN    << all_manager.bottom.install(((double)getBitmapHeight() - 1 - ymax) * v_scale)
+        << " " << CSS::WIDTH_CN     << all_manager.width.install(((double)(xmax - xmin + 1)) * h_scale)
+        << " " << CSS::HEIGHT_CN    << all_manager.height.install(((double)(ymax - ymin + 1)) * v_scale)
+        << "\" alt=\"\" decoding=\"async\" loading=\"lazy\" src=\"";
+
+    if(param.embed_image)
+    {
+        ifstream fin(path, ifstream::binary);
+        if(!fin)
+            throw string("Cannot read background image ") + path;
+
+        auto iter = FORMAT_MIME_TYPE_MAP.find(img_format);
+        if(iter == FORMAT_MIME_TYPE_MAP.end())
+            throw string("Image format not supported: ") + img_format;
+
+        string mime_type = iter->second;
+        f_page << "data:" << mime_type << ";base64," << Base64Stream(fin);
+    }
+    else
+    {
+        f_page << name;
+    }
+    f_page << "\"";
+    if(!srcset.empty())
+    {
+        // sizes is the width in CSS pixels, such that browsers choose by the device pixel ratio
+        f_page << " srcset=\"" << srcset << "\" sizes=\"" << (int)std::ceil((xmax - xmin + 1) * h_scale) << "px\"";
+    }
+    f_page << "/>";
 }
 
-// There might be mem leak when exception is thrown !
-void SplashBackgroundRenderer::dump_image(const char * filename, int x1, int y1, int x2, int y2)
+void SplashBackgroundRenderer::save_state(Json::Value & state) const
+{
+    save_image_names(dumped_images, state["images"]);
+}
+
+void SplashBackgroundRenderer::restore_state(const Json::Value & state)
+{
+    restore_image_names(dumped_images, state["images"]);
+}
+
+void SplashBackgroundRenderer::embed_preview(std::ostream & out, int pageno)
+{
+    // the DPI of the page may have been lowered (e.g. by --bg-pixel-budget), such that
+    // the preview would be as large as the background itself
+    int factor = (int)std::round(param.actual_dpi / param.bg_preview_dpi);
+    if(factor < 2)
+        return;
+
+    int width = getBitmapWidth();
+    int height = getBitmapHeight();
+
+    vector<unsigned char> buf;
+    {
+        auto rows = get_rows(0, 0, width - 1, height - 1);
+        downsample(rows.data(), width, height, factor, buf);
+    }
+    width = (width + factor - 1) / factor;
+    height = (height + factor - 1) / factor;
+    vector<unsigned char*> rows;
+    for(int y = 0; y < height; ++y)
+        rows.push_back(buf.data() + (size_t)y * width * 3);
+
+#ifdef ENABLE_LIBPNG
+    string img_format = "png";
+#else
+    string img_format = "jpg";
+#endif
+    string path = (char*)html_renderer->str_fmt("%s/bp%x.%s", param.tmp_dir.c_str(), pageno, img_format.c_str());
+    html_renderer->tmp_files.add(path);
+    dump_rows(path.c_str(), img_format, width, height, rows.data());
+
+    ifstream fin(path, ifstream::binary);
+    if(!fin)
+        throw string("Cannot read background image ") + path;
+    out << "<img class=\"" << CSS::PREVIEW_IMAGE_CN << "\" alt=\"\" src=\"data:"
+        << FORMAT_MIME_TYPE_MAP.at(img_format) << ";base64," << Base64Stream(fin) << "\"/>";
+}
+
+vector<unsigned char*> SplashBackgroundRenderer::get_rows(int x1, int y1, int x2, int y2)
+{
+    auto * bitmap = getBitmap();
+    assert(bitmap->getMode() == splashModeRGB8);
+
+    SplashColorPtr data = bitmap->getDataPtr();
+    int row_size = bitmap->getRowSize();
+
+    vector<unsigned char*> pointers;
+    pointers.reserve(y2 - y1 + 1);
+    SplashColorPtr p = data + y1 * row_size + x1 * 3;
+    for(int y = y1; y <= y2; ++y)
+    {
+        pointers.push_back(p);
+        p += row_size;
+    }
+    return pointers;
+}
+
+void SplashBackgroundRenderer::dump_image(const char * filename, const string & img_format, int x1, int y1, int x2, int y2)
 {
     int width = x2 - x1 + 1;
     int height = y2 - y1 + 1;
     if((width <= 0) || (height <= 0))
         throw "Bad metric for background image";
 
+    auto pointers = get_rows(x1, y1, x2, y2);
+    dump_rows(filename, img_format, width, height, pointers.data());
+}
+
+// There might be mem leak when exception is thrown !
+void SplashBackgroundRenderer::dump_rows(const char * filename, const string & img_format, int width, int height, unsigned char ** rows)
+{
     FILE * f = fopen(filename, "wb");
     if(!f)
         throw string("Cannot open file for background image " ) + filename;
 
-    // use unique_ptr to auto delete the object upon exception
-    unique_ptr<ImgWriter> writer;
-
-    if(false) { }
 #ifdef ENABLE_LIBPNG
-    else if(format == "png")
+    if(img_format == "png")
     {
-        writer = unique_ptr<ImgWriter>(new PNGWriter);
+        dump_png(f, width, height, rows);
+        fclose(f);
+        return;
     }
 #endif
+
+    // use unique_ptr to auto delete the object upon exception
+    unique_ptr<ImgWriter> writer;
+
+    if(false) { }
 #ifdef ENABLE_LIBJPEG
-    else if(format == "jpg")
+    else if(img_format == "jpg")
     {
         writer = unique_ptr<ImgWriter>(new JpegWriter);
     }
 #endif
     else
     {
-        throw string("Image format not supported: ") + format;
+        throw string("Image format not supported: ") + img_format;
     }
 
     if(!writer->init(f, width, height, param.actual_dpi, param.actual_dpi))
         throw "Cannot initialize image writer";
         
-    auto * bitmap = getBitmap();
-    assert(bitmap->getMode() == splashModeRGB8);
+    if(!writer->writePointers(rows, height)) 
+    {
+        throw "Cannot write background image";
+    }
 
-    SplashColorPtr data = bitmap->getDataPtr();
-    int row_size = bitmap->getRowSize();
+    if(!writer->close())
+    {
+        throw "Cannot finish background image";
+    }
 
-    vector<unsigned char*> pointers;
-    pointers.reserve(height);
-    SplashColorPtr p = data + y1 * row_size + x1 * 3;
-    for(int i = 0; i < height; ++i)
+    fclose(f);
+}
+
+#ifdef ENABLE_LIBPNG
+/*
+ * Build a palette for the RGB rows if possible, and convert pixels into indices
+ *
+ * The exact colors are used if there are no more than 256 of them
+ * Otherwise colors are grouped by dropping low bits of each channel, and each group
+ * is drawn with the mean of its colors, as long as the error of each channel is no more than MAX_ERROR
+ * Uniform areas (e.g. white paper) keep their exact color
+ */
+static bool build_palette(int width, int height, unsigned char ** rows, vector<png_color> & palette, vector<unsigned char> & indices)
+{
+    const int MAX_COLOR_COUNT = 256;
+    const int MAX_ERROR = 4;
+
+    struct ColorGroup
     {
-        pointers.push_back(p);
-        p += row_size;
+        uint64_t count, sum[3];
+        unsigned char min[3], max[3];
+    };
+
+    indices.resize((size_t)width * height);
+    for(int shift = 0; (shift == 0) || ((1 << (shift - 1)) <= MAX_ERROR); ++shift)
+    {
+        std::unordered_map<uint32_t, unsigned char> color_index;
+        vector<ColorGroup> groups;
+        bool ok = true;
+        for(int y = 0; ok && (y < height); ++y)
+        {
+            const unsigned char * p = rows[y];
+            unsigned char * q = indices.data() + (size_t)y * width;
+            for(int x = 0; x < width; ++x, p += 3)
+            {
+                uint32_t key = ((p[0] >> shift) << 16) | ((p[1] >> shift) << 8) | (p[2] >> shift);
+                auto iter = color_index.find(key);
+                if(iter == color_index.end())
+                {
+                    if((int)groups.size() == MAX_COLOR_COUNT)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    ColorGroup g;
+                    g.count = 0;
+                    for(int i = 0; i < 3; ++i)
+                    {
+                        g.sum[i] = 0;
+                        g.min[i] = g.max[i] = p[i];
+                    }
+                    iter = color_index.insert(std::make_pair(key, (unsigned char)groups.size())).first;
+                    groups.push_back(g);
+                }
+                ColorGroup & g = groups[iter->second];
+                ++g.count;
+                for(int i = 0; i < 3; ++i)
+                {
+                    g.sum[i] += p[i];
+                    g.min[i] = std::min(g.min[i], p[i]);
+                    g.max[i] = std::max(g.max[i], p[i]);
+                }
+                q[x] = iter->second;
+            }
+        }
+        if(!ok)
+            continue;
+
+        palette.clear();
+        for(auto & g : groups)
+        {
+            unsigned char mean[3];
+            for(int i = 0; i < 3; ++i)
+            {
+                mean[i] = (unsigned char)((g.sum[i] + g.count / 2) / g.count);
+                if((mean[i] - g.min[i] > MAX_ERROR) || (g.max[i] - mean[i] > MAX_ERROR))
+                    return false;
+            }
+            png_color c;
+            c.red = mean[0];
+            c.green = mean[1];
+            c.blue = mean[2];
+            palette.push_back(c);
+        }
+        return true;
+    }
+    return false;
+}
+
+void SplashBackgroundRenderer::dump_png(FILE * f, int width, int height, unsigned char ** rows)
+{
+    vector<png_color> palette;
+    vector<unsigned char> indices;
+    vector<unsigned char*> index_rows;
+    bool use_palette = (param.bg_png_mode == "palette") && build_palette(width, height, rows, palette, indices);
+    int bit_depth = 8;
+    if(use_palette)
+    {
+        index_rows.reserve(height);
+        for(int y = 0; y < height; ++y)
+            index_rows.push_back(indices.data() + (size_t)y * width);
+        rows = index_rows.data();
+
+        if(palette.size() <= 2)
+            bit_depth = 1;
+        else if(palette.size() <= 4)
+            bit_depth = 2;
+        else if(palette.size() <= 16)
+            bit_depth = 4;
     }
-    
-    if(!writer->writePointers(pointers.data(), height)) 
+
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if(!png_ptr)
+        throw "Cannot initialize image writer";
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if(!info_ptr)
+    {
+        png_destroy_write_struct(&png_ptr, nullptr);
+        throw "Cannot initialize image writer";
+    }
+
+    if(setjmp(png_jmpbuf(png_ptr)))
     {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
         throw "Cannot write background image";
     }
 
-    if(!writer->close())
+    png_init_io(png_ptr, f);
+    if(param.bg_png_compression_level >= 0)
+        png_set_compression_level(png_ptr, std::min(param.bg_png_compression_level, 9));
+
+    if(use_palette)
     {
-        throw "Cannot finish background image";
+        png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, PNG_COLOR_TYPE_PALETTE,
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_set_PLTE(png_ptr, info_ptr, palette.data(), palette.size());
+        // filters rarely help indexed images
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+    }
+    else
+    {
+        png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB,
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        // let libpng choose the best filter for each row
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
     }
 
-    fclose(f);
+    png_uint_32 ppm = (png_uint_32)(param.actual_dpi / 0.0254 + 0.5);
+    png_set_pHYs(png_ptr, info_ptr, ppm, ppm, PNG_RESOLUTION_METER);
+
+    png_write_info(png_ptr, info_ptr);
+    if(bit_depth < 8)
+        png_set_packing(png_ptr);
+
+    png_write_image(png_ptr, rows);
+    png_write_end(png_ptr, info_ptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
 }
+#endif
 
 } // namespace pdf2htmlEX
@@ -10,6 +10,10 @@
 #define SPLASH_BACKGROUND_RENDERER_H__
 
 #include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
 
 #include <splash/SplashBitmap.h>
 #include <SplashOutputDev.h>
@@ -26,7 +30,8 @@ class SplashBackgroundRenderer : public BackgroundRenderer, SplashOutputDev
 {
 public:
   static const SplashColor white;
-  //format: "png" or "jpg", or "" for a default format
+  static const SplashColor passthrough_marker;
+  //format: "png" or "jpg", "auto" for choosing per image, or "" for a default format
   SplashBackgroundRenderer(const std::string & format, HTMLRenderer * html_renderer, const Param & param);
 
   virtual ~SplashBackgroundRenderer() { }
@@ -34,6 +39,9 @@ public:
   virtual void init(PDFDoc * doc);
   virtual bool render_page(PDFDoc * doc, int pageno);
   virtual void embed_image(int pageno);
+  virtual void save_state(Json::Value & state) const;
+  virtual void restore_state(const Json::Value & state);
+  virtual void embed_preview(std::ostream & out, int pageno);
 
   // Does this device use beginType3Char/endType3Char?  Otherwise,
   // text in Type 3 fonts will be drawn with drawChar/drawString.
@@ -46,6 +54,9 @@ public:
       double originX, double originY,
       CharCode code, int nBytes, const Unicode *u, int uLen);
 
+  virtual void drawImage(GfxState *state, Object *ref, Stream *str, int width, int height,
+      GfxImageColorMap *colorMap, bool interpolate, const int *maskColors, bool inlineImg);
+
   //for proof
   void beginTextObject(GfxState *state);
   void beginString(GfxState *state, const GooString * str);
@@ -53,11 +64,43 @@ public:
   void updateRender(GfxState *state);
 
 protected:
-  void dump_image(const char * filename, int x1, int y1, int x2, int y2);
+  // jpeg image emitted as it is, in device space
+  struct PassthroughImage
+  {
+      int id; // object number of the image stream
+      double x1, y1, x2, y2;
+  };
+  bool passthrough_jpeg(GfxState * state, Object * ref, Stream * str);
+  bool get_covered_pixels(const PassthroughImage & image, int & x1, int & y1, int & x2, int & y2);
+  void commit_passthrough_images(void);
+  void fill_region(const SplashColor color, int x1, int y1, int x2, int y2);
+  bool is_filled_with(const SplashColor color, int x1, int y1, int x2, int y2);
+
+  // all coordinates are inclusive
+  void embed_image_region(std::string name, const std::string & img_format, int x1, int y1, int x2, int y2);
+  std::vector<unsigned char*> get_rows(int x1, int y1, int x2, int y2);
+  void dump_image(const char * filename, const std::string & img_format, int x1, int y1, int x2, int y2);
+  void dump_rows(const char * filename, const std::string & img_format, int width, int height, unsigned char ** rows);
+  std::string choose_format(int x1, int y1, int x2, int y2);
+#ifdef ENABLE_LIBPNG
+  void dump_png(FILE * f, int width, int height, unsigned char ** rows);
+#endif
+  bool is_blank(int x1, int y1, int x2, int y2);
+  ImageKey hash_image(const std::string & img_format, int x1, int y1, int x2, int y2);
+  // bounding box of non-white pixels, return false for blank pages
+  bool get_content_bbox(int & xmin, int & ymin, int & xmax, int & ymax);
   HTMLRenderer * html_renderer;
   const Param & param;
   std::string format;
   int drawn_char_count;
+  // content hash -> name of the dumped image file
+  ImageNameMap dumped_images;
+
+  SplashBitmap * page_bitmap;
+  bool passthrough_disabled;
+  std::vector<PassthroughImage> passthrough_images;
+  // object number -> jpeg data (dropped once the file is written, when images are not embedded)
+  std::unordered_map<int, std::string> jpeg_data;
 };
 
 } // namespace pdf2htmlEX
@@ -0,0 +1,96 @@
+/*
+ * Checkpoint.cc
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+
+#include "Checkpoint.h"
+#include "util/hash.h"
+
+using namespace std;
+
+namespace pdf2htmlEX {
+
+Checkpoint::Checkpoint(const Param & param)
+    : param(param)
+    , options_hash(0)
+    , resuming(false)
+{ }
+
+string Checkpoint::get_path(void) const
+{
+    return param.checkpoint_dir + "/checkpoint.json";
+}
+
+bool Checkpoint::init(const string & options)
+{
+    ContentHash hash;
+    hash.update(options);
+    options_hash = hash.get();
+
+    if(!param.resume)
+        return false;
+
+    ifstream in(get_path(), ifstream::binary);
+    if(!in)
+    {
+        cerr << "Warning: no checkpoint is found in " << param.checkpoint_dir << ", start from the first page" << endl;
+        return false;
+    }
+
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    string errors;
+    if(!Json::parseFromStream(builder, in, &root, &errors) || !root.isObject())
+    {
+        cerr << "Warning: ignore invalid checkpoint " << get_path() << ": " << errors << endl;
+        return false;
+    }
+
+    if(root["options"].asUInt64() != options_hash)
+    {
+        cerr << "Warning: the checkpoint was saved with different options or input, start from the first page" << endl;
+        return false;
+    }
+
+    state = root["state"];
+    resuming = true;
+    return true;
+}
+
+bool Checkpoint::is_due(int pageno) const
+{
+    return (param.checkpoint_interval > 0)
+        && ((pageno - param.first_page + 1) % param.checkpoint_interval == 0);
+}
+
+void Checkpoint::save(const Json::Value & state)
+{
+    Json::Value root(Json::objectValue);
+    root["options"] = (Json::UInt64)options_hash;
+    root["state"] = state;
+
+    string path = get_path();
+    string tmp_path = path + ".tmp";
+    {
+        ofstream out(tmp_path, ofstream::binary);
+        out << root.toStyledString();
+        out.flush();
+        if(!out)
+        {
+            cerr << "Warning: cannot write checkpoint " << tmp_path << endl;
+            return;
+        }
+    }
+    if(rename(tmp_path.c_str(), path.c_str()) != 0)
+        cerr << "Warning: cannot write checkpoint " << path << endl;
+}
+
+void Checkpoint::finish(void)
+{
+    remove(get_path().c_str());
+}
+
+} // namespace pdf2htmlEX
@@ -0,0 +1,59 @@
+/*
+ * Checkpoint.h
+ *
+ * Save the progress of a conversion, see --checkpoint-dir and --resume
+ */
+
+#ifndef CHECKPOINT_H__
+#define CHECKPOINT_H__
+
+#include <string>
+#include <cstdint>
+
+#include <jsoncpp/json/json.h>
+
+#include "Param.h"
+
+namespace pdf2htmlEX {
+
+/*
+ * A checkpoint is saved after a page is finished, it is a JSON file in param.checkpoint_dir,
+ * which is also the temporary directory, such that the files it refers to are kept.
+ *
+ * The content of the state is decided by HTMLRenderer.
+ */
+class Checkpoint
+{
+public:
+    explicit Checkpoint(const Param & param);
+
+    bool enabled(void) const { return !param.checkpoint_dir.empty(); }
+
+    /*
+     * options: everything that affects the output, including the input file
+     * Return true if there is a checkpoint to resume from, with the same options
+     */
+    bool init(const std::string & options);
+    bool is_resuming(void) const { return resuming; }
+    // the saved state, valid if is_resuming()
+    const Json::Value & get_state(void) const { return state; }
+
+    // whether a checkpoint should be saved after this page
+    bool is_due(int pageno) const;
+    // a crash while saving keeps the previous checkpoint
+    void save(const Json::Value & state);
+    // remove the checkpoint after a successful conversion
+    void finish(void);
+
+private:
+    std::string get_path(void) const;
+
+    const Param & param;
+    uint64_t options_hash;
+    bool resuming;
+    Json::Value state;
+};
+
+} // namespace pdf2htmlEX
+
+#endif //CHECKPOINT_H__
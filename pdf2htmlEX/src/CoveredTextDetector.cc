@@ -14,7 +14,7 @@
 
 namespace pdf2htmlEX {
 
-CoveredTextDetector::CoveredTextDetector(Param & param): param(param)
+CoveredTextDetector::CoveredTextDetector(Param & param): partially_covered(false), param(param)
 {
 }
 
@@ -23,6 +23,7 @@ void CoveredTextDetector::reset()
     char_bboxes.clear();
     chars_covered.clear();
     char_pts_visible.clear();
+    partially_covered = false;
 }
 
 void CoveredTextDetector::add_char_bbox(cairo_t *cairo, double * bbox)
@@ -44,13 +45,29 @@ void CoveredTextDetector::add_char_bbox_clipped(cairo_t *cairo, double * bbox, i
     if (pts_visible == 0 || param.correct_text_visibility == 2) {
         chars_covered.push_back(true);
         if (pts_visible > 0 && param.correct_text_visibility == 2) {
-            param.actual_dpi = std::min(param.text_dpi, param.max_dpi); // Char partially covered so increase background resolution
+            partially_covered = true; // Char partially covered so increase background resolution, see DPIPolicy
         }
     } else {
         chars_covered.push_back(false);
     }
 }
 
+CoveredTextDetector::Counters CoveredTextDetector::get_counters() const
+{
+    Counters counters;
+    counters.drawn = chars_covered.size();
+    counters.covered = 0;
+    counters.partially_covered = 0;
+    for (int i = 0; i < counters.drawn; i++) {
+        if (!chars_covered[i])
+            continue;
+        counters.covered++;
+        if (char_pts_visible[i] != 0)
+            counters.partially_covered++;
+    }
+    return counters;
+}
+
 // We now track the visibility of each corner of the char bbox. Potentially we could track
 // more sample points but this should be sufficient for most cases.
 // We check to see if each point is covered by any stroke or fill operation
@@ -104,7 +121,7 @@ printf("Char covered\n");
 #endif
                 chars_covered[i] = true;
                 if (pts_visible > 0 && param.correct_text_visibility == 2) { // Partially visible text => increase rendering DPI
-                    param.actual_dpi = std::min(param.text_dpi, param.max_dpi);
+                    partially_covered = true;
                 }
             }
         } else {
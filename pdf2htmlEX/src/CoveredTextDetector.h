@@ -52,14 +52,35 @@ public:
      * Index by the order that these chars are added.
      * This vector grows as add_char_bbox() is called, so its size is the count
      * of currently drawn chars.
+     * The vector is bit-packed and owned by the detector, bind it to a reference
+     * instead of copying it.
      */
-    const std::vector<bool> & get_chars_covered() { return chars_covered; }
+    const std::vector<bool> & get_chars_covered() const { return chars_covered; }
+
+    /**
+     * Whether any char is partially covered and hidden, which needs a higher
+     * background resolution (correct_text_visibility == 2).
+     */
+    bool has_partially_covered_chars() const { return partially_covered; }
+
+    struct Counters
+    {
+        int drawn;
+        // including partially covered ones
+        int covered;
+        int partially_covered;
+    };
+    /**
+     * Counters of chars drawn in current page, for diagnostics.
+     */
+    Counters get_counters() const;
 
 private:
     std::vector<bool> chars_covered;
     // x00, y00, x01, y01; x10, y10, x11, y11;...
     std::vector<double> char_bboxes;
     std::vector<int> char_pts_visible;
+    bool partially_covered;
     Param & param;
 };
 
@@ -0,0 +1,80 @@
+/*
+ * DPIPolicy.cc
+ */
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "DPIPolicy.h"
+#include "util/const.h"
+
+namespace pdf2htmlEX {
+
+// max width/height of background images, in pixels
+static const double MAX_DIMEN = 9000;
+
+DPIPolicy::DPIPolicy(Param & param)
+    : param(param)
+    , pageno(0)
+    , page_width(0)
+    , page_height(0)
+    , remaining_pages(0)
+    , remaining_pixels(-1)
+{ }
+
+void DPIPolicy::init(int page_count)
+{
+    remaining_pages = page_count;
+    remaining_pixels = (param.bg_pixel_budget > 0) ? (param.bg_pixel_budget * 1e6) : -1;
+}
+
+void DPIPolicy::begin_page(PDFDoc * doc, int pageno)
+{
+    this->pageno = pageno;
+    page_width = doc->getPageCropWidth(pageno);
+    page_height = doc->getPageCropHeight(pageno);
+
+    param.max_dpi = DEFAULT_DPI * MAX_DIMEN / std::max(page_width, page_height);
+    reason = "max dimension";
+
+    if((remaining_pixels >= 0) && (remaining_pages > 0))
+    {
+        // pixels are evenly shared by the remaining pages
+        double pixels = remaining_pixels / remaining_pages;
+        double budget_dpi = DEFAULT_DPI * std::sqrt(pixels / (page_width * page_height));
+        if(budget_dpi < param.max_dpi)
+        {
+            param.max_dpi = budget_dpi;
+            reason = "pixel budget";
+        }
+    }
+
+    param.actual_dpi = std::min(param.desired_dpi, param.max_dpi);
+}
+
+void DPIPolicy::require_text_dpi(void)
+{
+    if(param.actual_dpi != std::min(param.text_dpi, param.max_dpi))
+    {
+        param.actual_dpi = std::min(param.text_dpi, param.max_dpi);
+        if(param.text_dpi <= param.max_dpi)
+            reason = "partially covered text";
+    }
+}
+
+void DPIPolicy::end_page(void)
+{
+    if(param.actual_dpi != param.desired_dpi)
+        printf("Page %d DPI change %.1f => %.1f (%s)\n", pageno, param.desired_dpi, param.actual_dpi, reason.c_str());
+
+    if(remaining_pixels >= 0)
+    {
+        double scale = param.actual_dpi / DEFAULT_DPI;
+        remaining_pixels = std::max(0.0, remaining_pixels - (page_width * scale) * (page_height * scale));
+    }
+    if(remaining_pages > 0)
+        --remaining_pages;
+}
+
+} // namespace pdf2htmlEX
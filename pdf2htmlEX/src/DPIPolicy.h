@@ -0,0 +1,67 @@
+/*
+ * DPIPolicy.h
+ *
+ * Decide the resolution of background images for each page
+ */
+
+#ifndef DPIPOLICY_H__
+#define DPIPOLICY_H__
+
+#include <string>
+
+#include <PDFDoc.h>
+
+#include "Param.h"
+
+namespace pdf2htmlEX {
+
+/*
+ * The DPI of each page is decided in the following order:
+ *  - desired_dpi (--dpi)
+ *  - raised to text_dpi if some text is partially covered (--correct-text-visibility 2)
+ *  - limited by the max dimension of bitmaps
+ *  - limited by the pixels left in the budget (--bg-pixel-budget), shared by remaining pages
+ *
+ * There is no lower bound from the size of text rendered into the background, small text may
+ * become unreadable under a tight budget.
+ *
+ * The result is stored in param.actual_dpi, which is used by the background renderers.
+ */
+class DPIPolicy
+{
+public:
+    DPIPolicy(Param & param);
+
+    // should be called before any page is processed
+    void init(int page_count);
+
+    void begin_page(PDFDoc * doc, int pageno);
+    // partially covered text will be rendered into the background image
+    void require_text_dpi(void);
+    // log the decision and update the budget
+    void end_page(void);
+
+    // for checkpoints
+    int get_remaining_pages(void) const { return remaining_pages; }
+    double get_remaining_pixels(void) const { return remaining_pixels; }
+    void restore(int remaining_pages, double remaining_pixels) {
+        this->remaining_pages = remaining_pages;
+        this->remaining_pixels = remaining_pixels;
+    }
+
+private:
+    Param & param;
+
+    int pageno;
+    // size of the current page, in pt
+    double page_width, page_height;
+    std::string reason;
+
+    int remaining_pages;
+    // negative for no limit
+    double remaining_pixels;
+};
+
+} // namespace pdf2htmlEX
+
+#endif //DPIPOLICY_H__
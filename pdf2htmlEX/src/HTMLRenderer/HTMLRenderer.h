@@ -8,6 +8,7 @@
 #define HTMLRENDERER_H_
 
 #include <unordered_map>
+#include <set>
 #include <cstdint>
 #include <fstream>
 #include <memory>
@@ -17,6 +18,7 @@
 #include <Stream.h>
 #include <PDFDoc.h>
 #include <Outline.h>
+#include <Link.h>
 #include <StructTreeRoot.h>
 #include <StructElement.h>
 
@@ -60,7 +62,10 @@
 
 #include "Param.h"
 #include "Preprocessor.h"
+#include "PageCache.h"
+#include "Checkpoint.h"
 #include "StringFormatter.h"
+#include "Stats.h"
 #include "TmpFiles.h"
 #include "Color.h"
 #include "StateManager.h"
@@ -68,6 +73,7 @@
 #include "OutlineRec.h"
 #include "BackgroundRenderer/BackgroundRenderer.h"
 #include "CoveredTextDetector.h"
+#include "DPIPolicy.h"
 #include "DrawingTracer.h"
 
 #include "util/const.h"
@@ -202,6 +208,8 @@ struct HTMLRenderer : OutputDev
 
 
     void dump_tags(const std::string &filename);
+    // see --stats-json and --trace
+    void dump_stats(void);
 
 protected:
     ////////////////////////////////////////////////////
@@ -209,6 +217,8 @@ protected:
     ////////////////////////////////////////////////////
     void pre_process(PDFDoc * doc);
     void post_process(void);
+    // convert a page, dpi_policy.begin_page() should have been called
+    void process_page(PDFDoc * doc, int pageno);
 
     void process_outline(void);
     void process_outline_items(const std::vector<OutlineItem*> * items);
@@ -216,8 +226,12 @@ protected:
     void process_form(std::ofstream & out);
     
     void set_stream_flags (std::ostream & out);
+    // options affecting the output, for the page cache and checkpoints
+    std::string get_options_fingerprint(void);
 
     void dump_css(void);
+    // the opening tag of a frame in f_pages, for split pages
+    void dump_empty_frame(int pageno, long long wid, long long hid, const std::string & page_filename);
 
     static std::string UnicodeToUTF8(const Unicode *str, int len);
     void dump_outline(OutlineRecMap *outline, const std::vector<OutlineItem *> *items, int firstpage, int lastpage, int deep = 0);
@@ -227,6 +241,55 @@ protected:
     // convert a LinkAction to a string that our Javascript code can understand
     std::string get_linkaction_str(const LinkAction *, std::string & detail);
 
+    struct DestInfo
+    {
+        std::unique_ptr<LinkDest> dest;
+        int pageno = 0; // 0 if the page is not found
+        std::string detail;
+    };
+    /*
+     * Resolve the destination of a GoTo action, nullptr if there is none
+     * Named destinations are cached, others are stored in buf
+     */
+    const DestInfo * find_dest(const LinkGoTo * action, DestInfo & buf);
+    // Catalog::findPage with an index of page refs
+    int find_page(const Ref & ref);
+
+    ////////////////////////////////////////////////////
+    // page cache, see --page-cache
+    ////////////////////////////////////////////////////
+    void init_page_cache(PDFDoc * doc);
+    // the page and its outline items
+    ContentHash hash_page(int pageno);
+    // codes used by a font, after merging duplicated fonts
+    uint64_t hash_code_map(long long fn_id);
+    // write the cached page, false if it is not found or not valid anymore
+    bool reuse_cached_page(int pageno, const ContentHash & hash);
+    void cache_page(int pageno, const ContentHash & hash, long long frame_begin, const std::string & page_path);
+    // a file in dest_dir used by the current page, to be stored with it in the page cache
+    void add_page_file(const std::string & path);
+
+    ////////////////////////////////////////////////////
+    // checkpoints, see --checkpoint-dir and --resume
+    ////////////////////////////////////////////////////
+    void init_checkpoint(void);
+    // open an output file, when resuming keep what was written before the checkpoint
+    void open_output(std::ofstream & fs, const std::string & path, const char * name);
+    void save_checkpoint(int next_page);
+    // should be called after the background renderers and dpi_policy are initialized
+    void restore_checkpoint(void);
+
+    ////////////////////////////////////////////////////
+    // convert pages on demand, see --serve
+    ////////////////////////////////////////////////////
+    // frames of all pages, with the size from the page boxes
+    void dump_empty_frames(void);
+    // answer requests until "quit" is received
+    void serve(void);
+    // return the reply, including the trailing newline
+    std::string serve_request(const std::string & request, bool & quit);
+    void discard_page(int pageno);
+
     ////////////////////////////////////////////////////
     /*
      * manage fonts
@@ -241,6 +304,10 @@ protected:
      * local font: to be substituted with a local (client side) font
      */
     ////////////////////////////////////////////////////
+    // locate the font program of an embedded font, throw 0 upon failure
+    Object get_embedded_font_stream(const std::shared_ptr<GfxFont> font, std::string & suffix);
+    // find fonts sharing the same font program, which can be exported as a single web font
+    void detect_duplicate_fonts(void);
     std::string dump_embedded_font(const std::shared_ptr<GfxFont> font, FontInfo & info);
     std::string dump_type3_font(const std::shared_ptr<GfxFont> font, FontInfo & info);
     void embed_font(const std::string & filepath, const std::shared_ptr<GfxFont> font, FontInfo & info, bool get_metric_only = false);
@@ -277,6 +344,9 @@ protected:
     XRef * xref;
     PDFDoc * cur_doc;
     Catalog * cur_catalog;
+    // built on demand, see find_dest and find_page
+    std::unordered_map<std::string, DestInfo> named_dests;
+    std::unordered_map<long long, int> page_refs;
     int pageNum;
 
     double default_ctm[6];
@@ -348,6 +418,8 @@ protected:
     ////////////////////////////////////////////////////
     // managers store values actually used in HTML (i.e. scaled)
     std::unordered_map<long long, FontInfo> font_info_map;
+    // duplicated font -> the font whose web font is used instead
+    std::unordered_map<long long, std::shared_ptr<GfxFont>> font_alias_map;
     AllStateManager all_manager;
     HTMLTextState cur_text_state;
     HTMLLineState cur_line_state;
@@ -372,6 +444,24 @@ protected:
 
     // manage temporary files
     TmpFiles tmp_files;
+    // timings and counters for --stats-json and --trace
+    Stats stats;
+
+    PageCache page_cache;
+    // fonts installed in the current page, by hash_ref of their IDs
+    std::unordered_map<long long, std::shared_ptr<GfxFont>> cur_page_fonts;
+    // font key in page_cache -> font
+    std::unordered_map<uint64_t, std::shared_ptr<GfxFont>> fonts_by_cache_key;
+    // files used by the current page, and by all pages, relative to dest_dir
+    std::set<std::string> cur_page_files;
+    std::set<std::string> page_files;
+
+    Checkpoint checkpoint;
+
+    // pages converted by serve()
+    std::set<int> served_pages;
+    // the size of each table at the last dump_css()
+    AllStateSizes dumped_css_sizes;
 
     // for string formatting
     StringFormatter str_fmt;
@@ -396,6 +486,7 @@ protected:
     static const std::string MANIFEST_FILENAME;
 
     CoveredTextDetector covered_text_detector;
+    DPIPolicy dpi_policy;
     DrawingTracer tracer;
     
     std::vector<MCItem> mc_items;
@@ -0,0 +1,179 @@
+/*
+ * cache.cc
+ *
+ * Reuse unchanged pages, see --page-cache
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <iterator>
+
+#include "HTMLRenderer.h"
+#include "util/namespace.h"
+#include "util/hash.h"
+#include "util/misc.h"
+
+namespace pdf2htmlEX {
+
+using std::cerr;
+using std::vector;
+using std::pair;
+using std::ostringstream;
+
+void HTMLRenderer::init_page_cache(PDFDoc * doc)
+{
+    ostringstream options;
+    options.precision(17);
+    // the max page size decides the zoom factor
+    options << get_options_fingerprint() << ' ' << preprocessor.get_max_width() << ' ' << preprocessor.get_max_height();
+
+    page_cache.load(doc, options.str());
+    page_cache.restore_states(all_manager);
+
+    for(auto & f : preprocessor.get_fonts())
+        fonts_by_cache_key.insert(make_pair(page_cache.hash_font(f.second), f.second));
+}
+
+ContentHash HTMLRenderer::hash_page(int pageno)
+{
+    ContentHash hash;
+    page_cache.hash_page(pageno, hash);
+
+    auto iter = outline_recs.find(pageno);
+    if(iter != outline_recs.end())
+    {
+        for(auto & rec : iter->second)
+        {
+            double pos[3] = { rec.left, rec.top, rec.bottom };
+            hash.update(pos, sizeof(pos));
+            hash.update(rec.title);
+            hash.update(&rec.level, sizeof(rec.level));
+            hash.update(rec.text.data(), rec.text.size() * sizeof(rec.text[0]));
+        }
+    }
+
+    return hash;
+}
+
+uint64_t HTMLRenderer::hash_code_map(long long fn_id)
+{
+    auto alias_iter = font_alias_map.find(fn_id);
+    if(alias_iter != font_alias_map.end())
+        fn_id = hash_ref(alias_iter->second->getID());
+
+    ContentHash hash;
+    const auto & fonts = preprocessor.get_fonts();
+    auto font_iter = fonts.find(fn_id);
+    const char * code_map = preprocessor.get_code_map(fn_id);
+    if((font_iter != fonts.end()) && code_map)
+        hash.update(code_map, font_iter->second->isCIDFont() ? 0x10000 : 0x100);
+    return hash.get();
+}
+
+bool HTMLRenderer::reuse_cached_page(int pageno, const ContentHash & hash)
+{
+    auto page = page_cache.find_page(pageno, hash);
+    if(!page)
+        return false;
+
+    // the reencoding of a font depends on codes used in all pages
+    vector<std::shared_ptr<GfxFont>> fonts;
+    for(auto & f : page->fonts)
+    {
+        std::shared_ptr<GfxFont> font;
+        if(f.first != 0)
+        {
+            auto iter = fonts_by_cache_key.find(f.first);
+            if(iter == fonts_by_cache_key.end())
+                return false;
+            font = iter->second;
+        }
+        if(hash_code_map(font ? hash_ref(font->getID()) : 0) != f.second)
+            return false;
+        fonts.push_back(font);
+    }
+
+    /*
+     * Files of the page, e.g. background images shared with an earlier page, may have been
+     * written with different content by pages converted in this run.
+     * Other files are left from previous conversions, and can be overwritten.
+     */
+    vector<pair<string, string>> files_to_write;
+    for(auto & f : page->files)
+    {
+        string content;
+        page_cache.read_file(f, content);
+
+        string path = param.dest_dir + "/" + f.name;
+        ifstream in(path, ifstream::binary);
+        if(in)
+        {
+            string old_content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            if(old_content == content)
+                continue;
+            if(page_files.count(f.name))
+                return false;
+        }
+        files_to_write.push_back(make_pair(path, std::move(content)));
+    }
+
+    for(auto & f : files_to_write)
+    {
+        ofstream out(f.first, ofstream::binary);
+        out << f.second;
+        if(!out)
+            throw string("Cannot write ") + f.first;
+    }
+    for(auto & f : page->files)
+    {
+        add_page_file(param.dest_dir + "/" + f.name);
+        stats.add_output_file(param.dest_dir + "/" + f.name);
+    }
+
+    string frame, page_html;
+    page_cache.read_page(*page, frame, page_html);
+
+    // CSS of the fonts
+    for(auto & font : fonts)
+        install_font(font);
+
+    f_pages.fs << frame;
+    if(param.split_pages)
+        (*f_curpage) << page_html;
+
+    if(param.debug)
+        cerr << "Page " << pageno << " is taken from the page cache" << endl;
+    stats.add_count("cached_pages", 1);
+
+    return true;
+}
+
+void HTMLRenderer::cache_page(int pageno, const ContentHash & hash, long long frame_begin, const string & page_path)
+{
+    vector<pair<uint64_t, uint64_t>> fonts;
+    for(auto & p : cur_page_fonts)
+    {
+        // fonts without any char drawn, which are not known by the preprocessor, are not needed
+        if(p.second && (fonts_by_cache_key.count(page_cache.hash_font(p.second)) == 0))
+            continue;
+        fonts.push_back(make_pair(page_cache.hash_font(p.second), hash_code_map(p.first)));
+    }
+
+    page_cache.add_page(pageno, hash, fonts, frame_begin, f_pages.fs.tellp(), page_path,
+            vector<string>(cur_page_files.begin(), cur_page_files.end()));
+}
+
+void HTMLRenderer::add_page_file(const string & path)
+{
+    if(!page_cache.enabled())
+        return;
+
+    // path is always in dest_dir
+    string name = path.substr(param.dest_dir.size() + 1);
+    cur_page_files.insert(name);
+    page_files.insert(name);
+}
+
+} // namespace pdf2htmlEX
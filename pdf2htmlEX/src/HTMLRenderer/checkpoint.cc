@@ -0,0 +1,148 @@
+/*
+ * checkpoint.cc
+ *
+ * Save and restore the progress of a conversion, see --checkpoint-dir and --resume
+ */
+
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <system_error>
+#include <sys/stat.h>
+
+#include "HTMLRenderer.h"
+#include "BackgroundRenderer/BackgroundRenderer.h"
+#include "util/namespace.h"
+
+namespace pdf2htmlEX {
+
+using std::cerr;
+using std::ostringstream;
+
+void HTMLRenderer::init_checkpoint(void)
+{
+    ostringstream options;
+    options << get_options_fingerprint();
+
+    // the input file should not be changed in between
+    struct stat st;
+    if(stat(param.input_filename.c_str(), &st) == 0)
+        options << ' ' << (long long)st.st_size << ' ' << (long long)st.st_mtime;
+
+    if(checkpoint.init(options.str()) && (param.quiet == 0))
+        cerr << "Resume from page " << checkpoint.get_state()["next_page"].asInt() << endl;
+}
+
+void HTMLRenderer::open_output(std::ofstream & fs, const string & path, const char * name)
+{
+    if(checkpoint.is_resuming())
+    {
+        // drop what was written after the checkpoint
+        std::error_code ec;
+        std::filesystem::resize_file(path, checkpoint.get_state()["files"][name].asUInt64(), ec);
+        if(ec)
+            throw string("Cannot resume from ") + path + ": " + ec.message();
+        fs.open(path, ofstream::binary | ofstream::app);
+    }
+    else
+    {
+        fs.open(path, ofstream::binary);
+    }
+}
+
+void HTMLRenderer::save_checkpoint(int next_page)
+{
+    Stats::Timer timer(stats, "checkpoint");
+
+    /*
+     * {
+     *   "next_page": page number,
+     *   "files": { "css": length, "pages": length },
+     *   "states": { "<manager>": [ [value..., id] ] },
+     *   "fonts": [ [fn_id, id, use_tounicode, em_size, space_width, ascent, descent, is_type3, font_size_scale] ],
+     *   "tmp_files": [ path ],
+     *   "dpi_policy": [ remaining pages, remaining pixels ],
+     *   "bg_renderer": ..., "fallback_bg_renderer": ...
+     * }
+     */
+    Json::Value state(Json::objectValue);
+    state["next_page"] = next_page;
+
+    f_css.fs.flush();
+    f_pages.fs.flush();
+    if(!f_css.fs || !f_pages.fs)
+    {
+        cerr << "Warning: cannot write output files, checkpoint is not saved" << endl;
+        return;
+    }
+    state["files"]["css"] = (Json::UInt64)f_css.fs.tellp();
+    state["files"]["pages"] = (Json::UInt64)f_pages.fs.tellp();
+
+    save_state_tables(all_manager, state["states"]);
+
+    Json::Value & fonts = state["fonts"];
+    fonts = Json::Value(Json::arrayValue);
+    for(auto & p : font_info_map)
+    {
+        const FontInfo & info = p.second;
+        Json::Value e(Json::arrayValue);
+        e.append((Json::Int64)p.first);
+        e.append((Json::Int64)info.id);
+        e.append(info.use_tounicode);
+        e.append(info.em_size);
+        e.append(info.space_width);
+        e.append(info.ascent);
+        e.append(info.descent);
+        e.append(info.is_type3);
+        e.append(info.font_size_scale);
+        fonts.append(e);
+    }
+
+    Json::Value & files = state["tmp_files"];
+    files = Json::Value(Json::arrayValue);
+    for(auto & fn : tmp_files.get_files())
+        files.append(fn);
+
+    state["dpi_policy"].append(dpi_policy.get_remaining_pages());
+    state["dpi_policy"].append(dpi_policy.get_remaining_pixels());
+
+    if(bg_renderer)
+        bg_renderer->save_state(state["bg_renderer"]);
+    if(fallback_bg_renderer)
+        fallback_bg_renderer->save_state(state["fallback_bg_renderer"]);
+
+    checkpoint.save(state);
+}
+
+void HTMLRenderer::restore_checkpoint(void)
+{
+    const Json::Value & state = checkpoint.get_state();
+
+    restore_state_tables(all_manager, state["states"]);
+
+    for(auto & e : state["fonts"])
+    {
+        FontInfo info;
+        info.id = e[1].asInt64();
+        info.use_tounicode = e[2].asBool();
+        info.em_size = e[3].asInt();
+        info.space_width = e[4].asDouble();
+        info.ascent = e[5].asDouble();
+        info.descent = e[6].asDouble();
+        info.is_type3 = e[7].asBool();
+        info.font_size_scale = e[8].asDouble();
+        font_info_map.insert(make_pair(e[0].asInt64(), info));
+    }
+
+    for(auto & fn : state["tmp_files"])
+        tmp_files.add(fn.asString());
+
+    dpi_policy.restore(state["dpi_policy"][0].asInt(), state["dpi_policy"][1].asDouble());
+
+    if(bg_renderer)
+        bg_renderer->restore_state(state["bg_renderer"]);
+    if(fallback_bg_renderer)
+        fallback_bg_renderer->restore_state(state["fallback_bg_renderer"]);
+}
+
+} // namespace pdf2htmlEX
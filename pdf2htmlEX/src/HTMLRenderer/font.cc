@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <sstream>
 #include <cctype>
+#include <cstring>
 #include <unordered_set>
 
 #include <GlobalParams.h>
@@ -30,6 +31,7 @@
 #include "util/path.h"
 #include "util/unicode.h"
 #include "util/css_const.h"
+#include "util/hash.h"
 
 #if ENABLE_SVG
 #include <cairo.h>
@@ -44,119 +46,130 @@ namespace pdf2htmlEX {
 
 using std::min;
 using std::unordered_set;
+using std::unordered_map;
 using std::cerr;
 using std::endl;
 
-string HTMLRenderer::dump_embedded_font (const std::shared_ptr<GfxFont> font, FontInfo & info)
+Object HTMLRenderer::get_embedded_font_stream (const std::shared_ptr<GfxFont> font, string & suffix)
 {
-    if(info.is_type3)
-        return dump_type3_font(font, info);
-
     Object obj, obj1, obj2;
     Object font_obj, font_obj2, fontdesc_obj;
-    string suffix;
-    string filepath;
 
-    long long fn_id = info.id;
+    // inspired by mupdf 
+    string subtype;
 
-    try
-    {
-        // inspired by mupdf 
-        string subtype;
+    auto * id = font->getID();
 
-        auto * id = font->getID();
+    Object ref_obj(*id);
+    //ref_obj.initRef(id->num, id->gen);
+    font_obj = ref_obj.fetch(xref);
+    //ref_obj.free();
 
-        Object ref_obj(*id);
-        //ref_obj.initRef(id->num, id->gen);
-        font_obj = ref_obj.fetch(xref);
-        //ref_obj.free();
+    if(!font_obj.isDict())
+    {
+        cerr << "Font object is not a dictionary" << endl;
+        throw 0;
+    }
 
-        if(!font_obj.isDict())
+    Dict * dict = font_obj.getDict();
+    font_obj2 = dict->lookup("DescendantFonts");
+    if(font_obj2.isArray())
+    {
+        if(font_obj2.arrayGetLength() == 0)
         {
-            cerr << "Font object is not a dictionary" << endl;
-            throw 0;
+            cerr << "Warning: empty DescendantFonts array" << endl;
         }
-
-        Dict * dict = font_obj.getDict();
-        font_obj2 = dict->lookup("DescendantFonts");
-        if(font_obj2.isArray())
+        else
         {
-            if(font_obj2.arrayGetLength() == 0)
-            {
-                cerr << "Warning: empty DescendantFonts array" << endl;
+            if(font_obj2.arrayGetLength() > 1) {
+                cerr << "TODO: multiple entries in DescendantFonts array" << endl;
             }
-            else
+            
+            obj2 = font_obj2.arrayGet(0);
+            if(obj2.isDict())
             {
-                if(font_obj2.arrayGetLength() > 1) {
-                    cerr << "TODO: multiple entries in DescendantFonts array" << endl;
-                }
-                
-                obj2 = font_obj2.arrayGet(0);
-                if(obj2.isDict())
-                {
-                    dict = obj2.getDict();
-                }
+                dict = obj2.getDict();
             }
         }
+    }
 
-        fontdesc_obj = dict->lookup("FontDescriptor");
-        if(!fontdesc_obj.isDict())
-        {
-            cerr << "Cannot find FontDescriptor " << endl;
-            throw 0;
-        }
+    fontdesc_obj = dict->lookup("FontDescriptor");
+    if(!fontdesc_obj.isDict())
+    {
+        cerr << "Cannot find FontDescriptor " << endl;
+        throw 0;
+    }
 
-        dict = fontdesc_obj.getDict();
-        obj = dict->lookup("FontFile3");
-        if(obj.isStream())
+    dict = fontdesc_obj.getDict();
+    obj = dict->lookup("FontFile3");
+    if(obj.isStream())
+    {
+        obj1 = obj.streamGetDict()->lookup("Subtype");
+        if(obj1.isName())
         {
-            obj1 = obj.streamGetDict()->lookup("Subtype");
-            if(obj1.isName())
+            subtype = obj1.getName();
+            if(subtype == "Type1C")
             {
-                subtype = obj1.getName();
-                if(subtype == "Type1C")
-                {
-                    suffix = ".cff";
-                }
-                else if (subtype == "CIDFontType0C")
-                {
-                    suffix = ".cid";
-                }
-                else if (subtype == "OpenType")
-                {
-                    suffix = ".otf";
-                }
-                else
-                {
-                    cerr << "Unknown subtype: " << subtype << endl;
-                    throw 0;
-                }
+                suffix = ".cff";
+            }
+            else if (subtype == "CIDFontType0C")
+            {
+                suffix = ".cid";
+            }
+            else if (subtype == "OpenType")
+            {
+                suffix = ".otf";
             }
             else
             {
-                cerr << "Invalid subtype in font descriptor" << endl;
+                cerr << "Unknown subtype: " << subtype << endl;
                 throw 0;
             }
+        }
+        else
+        {
+            cerr << "Invalid subtype in font descriptor" << endl;
+            throw 0;
+        }
+    } else {
+        obj = dict->lookup("FontFile2");
+        if (obj.isStream()) {
+            suffix = ".ttf";
         } else {
-            obj = dict->lookup("FontFile2");
+            obj = dict->lookup("FontFile");
             if (obj.isStream()) {
-                suffix = ".ttf";
+                suffix = ".pfa";
             } else {
-                obj = dict->lookup("FontFile");
-                if (obj.isStream()) {
-                    suffix = ".pfa";
-                } else {
-                    cerr << "Cannot find FontFile for dump" << endl;
-                    throw 0;
-                }
+                cerr << "Cannot find FontFile for dump" << endl;
+                throw 0;
             }
         }
+    }
 
-        if(suffix == "")
-        {
-            cerr << "Font type unrecognized" << endl;
-            throw 0;
-        }
+    if(suffix == "")
+    {
+        cerr << "Font type unrecognized" << endl;
+        throw 0;
+    }
+
+    return obj;
+}
+
+string HTMLRenderer::dump_embedded_font (const std::shared_ptr<GfxFont> font, FontInfo & info)
+{
+    Stats::Timer timer(stats, "dump_font", info.id);
+
+    if(info.is_type3)
+        return dump_type3_font(font, info);
+
+    string suffix;
+    string filepath;
+
+    long long fn_id = info.id;
+
+    try
+    {
+        Object obj = get_embedded_font_stream(font, suffix);
 
         obj.streamReset();
 
@@ -180,17 +193,29 @@ string HTMLRenderer::dump_embedded_font (const std::shared_ptr<GfxFont> font, Fo
         cerr << "Something wrong when trying to dump font " << hex << fn_id << dec << endl;
     }
 
-    //obj2.free();
-    //obj1.free();
-    //obj.free();
+    return filepath;
+}
 
-    //fontdesc_obj.free();
-    //font_obj2.free();
-    //font_obj.free();
+#if ENABLE_SVG
+namespace {
 
-    return filepath;
+struct Type3GlyphSVG
+{
+    int code;
+    std::string svg;
+    double ox, oy, width;
+    std::string error;
+};
+
+cairo_status_t append_to_string(void * closure, const unsigned char * data, unsigned int length)
+{
+    static_cast<std::string*>(closure)->append((const char *)data, length);
+    return CAIRO_STATUS_SUCCESS;
 }
 
+} // namespace
+#endif
+
 string HTMLRenderer::dump_type3_font (const std::shared_ptr<GfxFont> font, FontInfo & info)
 {
     assert(info.is_type3);
@@ -226,30 +251,33 @@ string HTMLRenderer::dump_type3_font (const std::shared_ptr<GfxFont> font, FontI
     const double GLYPH_DUMP_EM_SIZE = 100.0;
     double scale = GLYPH_DUMP_EM_SIZE / info.font_size_scale;
 
-    // we choose ttf as it does not use char names
-    // or actually we don't use char names for ttf (see embed_font)
-    ffw_new_font();
-    // dump each glyph into svg and combine them
+    // glyphs are rendered into in-memory SVG documents, one by one
+    // the cairo user font and the font engine are shared by all glyphs, they are not thread-safe
+    std::vector<Type3GlyphSVG> glyphs;
     for(int code = 0; code < 256; ++code)
     {
         if(!used_map[code]) continue;
+        glyphs.emplace_back();
+        glyphs.back().code = code;
+    }
 
-        cairo_surface_t * surface = nullptr;
-
-        string glyph_filename = (char*)str_fmt("%s/f%llx-%x.svg", param.tmp_dir.c_str(), fn_id, code);
-        tmp_files.add(glyph_filename);
-
-        surface = cairo_svg_surface_create(glyph_filename.c_str(), transformed_bbox_width * scale, transformed_bbox_height * scale);
+    auto render_glyph = [&](Type3GlyphSVG & glyph) {
+        Stats::Timer timer(stats, "type3_glyph", info.id, true);
+        int code = glyph.code;
+        cairo_surface_t * surface = cairo_svg_surface_create_for_stream(append_to_string, &glyph.svg,
+                transformed_bbox_width * scale, transformed_bbox_height * scale);
 
         cairo_svg_surface_restrict_to_version(surface, CAIRO_SVG_VERSION_1_2);
         cairo_surface_set_fallback_resolution(surface, param.actual_dpi, param.actual_dpi);
         cairo_t * cr = cairo_create(surface);
 
         // track the position of the origin
-        double ox, oy;
+        double & ox = glyph.ox;
+        double & oy = glyph.oy;
         ox = oy = 0.0;
 
-        auto glyph_width = (std::dynamic_pointer_cast<Gfx8BitFont>(font))->getWidth(code);
+        double & glyph_width = glyph.width;
+        glyph_width = (std::dynamic_pointer_cast<Gfx8BitFont>(font))->getWidth(code);
 
 #if 1
         {
@@ -265,11 +293,11 @@ string HTMLRenderer::dump_type3_font (const std::shared_ptr<GfxFont> font, FontI
             cairo_matrix_multiply(&m1, &m1, &m2);
             cairo_set_font_matrix(cr, &m1);
 
-            cairo_glyph_t glyph;
-            glyph.index = cur_font->getGlyph(code, nullptr, 0);
-            glyph.x = 0;
-            glyph.y = GLYPH_DUMP_EM_SIZE;
-            cairo_show_glyphs(cr, &glyph, 1);
+            cairo_glyph_t cairo_glyph;
+            cairo_glyph.index = cur_font->getGlyph(code, nullptr, 0);
+            cairo_glyph.x = 0;
+            cairo_glyph.y = GLYPH_DUMP_EM_SIZE;
+            cairo_show_glyphs(cr, &cairo_glyph, 1);
 
 
             // apply the type 3 font's font matrix before m1
@@ -353,18 +381,47 @@ string HTMLRenderer::dump_type3_font (const std::shared_ptr<GfxFont> font, FontI
             auto status = cairo_status(cr);
             cairo_destroy(cr);
             if(status)
-                throw string("Cairo error: ") + cairo_status_to_string(status);
+                glyph.error = string("Cairo error: ") + cairo_status_to_string(status);
         }
         cairo_surface_finish(surface);
         {
             auto status = cairo_surface_status(surface);
             cairo_surface_destroy(surface);
             surface = nullptr;
-            if(status)
-                throw string("Error in cairo: ") + cairo_status_to_string(status);
+            if(status && glyph.error.empty())
+                glyph.error = string("Error in cairo: ") + cairo_status_to_string(status);
+        }
+    };
+
+    for(auto & glyph : glyphs)
+        render_glyph(glyph);
+
+    // we choose ttf as it does not use char names
+    // or actually we don't use char names for ttf (see embed_font)
+    ffw_new_font();
+    // FontForge is not thread-safe, and it can only import from files
+    for(auto & glyph : glyphs)
+    {
+        if(!glyph.error.empty())
+        {
+            ffw_close();
+            throw glyph.error;
         }
 
-        ffw_import_svg_glyph(code, glyph_filename.c_str(), ox / GLYPH_DUMP_EM_SIZE, -oy / GLYPH_DUMP_EM_SIZE, glyph_width / GLYPH_DUMP_EM_SIZE);
+        string glyph_filename = (char*)str_fmt("%s/f%llx-%x.svg", param.tmp_dir.c_str(), fn_id, glyph.code);
+        tmp_files.add(glyph_filename);
+        {
+            ofstream outf(glyph_filename, ofstream::binary);
+            if(!outf)
+            {
+                ffw_close();
+                throw string("Cannot open file ") + glyph_filename + " for writing";
+            }
+            outf << glyph.svg;
+        }
+        glyph.svg.clear();
+
+        ffw_import_svg_glyph(glyph.code, glyph_filename.c_str(), glyph.ox / GLYPH_DUMP_EM_SIZE, -glyph.oy / GLYPH_DUMP_EM_SIZE, glyph.width / GLYPH_DUMP_EM_SIZE);
     }
 
     string font_filename = (char*)str_fmt("%s/f%llx.ttf", param.tmp_dir.c_str(), fn_id);
@@ -388,6 +445,9 @@ void output_map_file_header(std::ostream& out) {
 
 void HTMLRenderer::embed_font(const string & filepath, const std::shared_ptr<GfxFont> font, FontInfo & info, bool get_metric_only)
 {
+    Stats::Timer timer(stats, "embed_font", info.id);
+    Stats::Timer step_timer(stats, "embed_font.load", info.id);
+
     if(param.debug)
     {
         cerr << "Embed font: " << filepath << " " << info.id << endl;
@@ -450,6 +510,8 @@ void HTMLRenderer::embed_font(const string & filepath, const std::shared_ptr<Gfx
 
     used_map = preprocessor.get_code_map(hash_ref(font->getID()));
 
+    step_timer.next("embed_font.reencode");
+
     /*
      * Step 1
      * dump the font file directly from the font descriptor and put the glyphs into the correct slots *
@@ -780,6 +842,7 @@ void HTMLRenderer::embed_font(const string & filepath, const std::shared_ptr<Gfx
     string other_tmp_fn = (char*)str_fmt("%s/__tmp_font2.%s", param.tmp_dir.c_str(), "ttf");
     tmp_files.add(other_tmp_fn);
 
+    step_timer.next("embed_font.save");
     ffw_save(cur_tmp_fn.c_str());
 
     ffw_close();
@@ -788,6 +851,7 @@ void HTMLRenderer::embed_font(const string & filepath, const std::shared_ptr<Gfx
      * Step 4
      * Font Hinting
      */
+    step_timer.next("embed_font.hint");
     bool hinted = false;
 
     // Call external hinting program if specified 
@@ -824,7 +888,10 @@ void HTMLRenderer::embed_font(const string & filepath, const std::shared_ptr<Gfx
 
     if(param.embed_font)
         tmp_files.add(fn);
+    else
+        stats.add_output_file(fn);
 
+    step_timer.next("embed_font.finalize");
     ffw_load_font(cur_tmp_fn.c_str());
     ffw_fix_metric();
     ffw_get_metric(&info.ascent, &info.descent);
@@ -836,17 +903,201 @@ void HTMLRenderer::embed_font(const string & filepath, const std::shared_ptr<Gfx
 }
 
 
+namespace {
+
+bool same_unicode_mapping(const CharCodeToUnicode * ctu1, const CharCodeToUnicode * ctu2, CharCode code)
+{
+    Unicode const *u1 = nullptr, *u2 = nullptr;
+    int n1 = ctu1 ? ((CharCodeToUnicode *)ctu1)->mapToUnicode(code, &u1) : 0;
+    int n2 = ctu2 ? ((CharCodeToUnicode *)ctu2)->mapToUnicode(code, &u2) : 0;
+    return (n1 == n2) && std::equal(u1, u1 + n1, u2);
+}
+
+/*
+ * Check if `font` can be rendered with the web font generated from `primary`,
+ * given that they share the same font program.
+ *
+ * All codes used by `font` must be mapped to the same glyph, unicode and width by `primary`.
+ * Codes not used by `font` do not matter, such that fonts with different encodings may still be merged.
+ */
+bool is_font_compatible(const std::shared_ptr<GfxFont> primary, const std::shared_ptr<GfxFont> font, const char * used_map)
+{
+    if((primary->isCIDFont() != font->isCIDFont())
+            || (primary->getType() != font->getType())
+            || (primary->getFlags() != font->getFlags()))
+        return false;
+
+    auto ctu1 = primary->getToUnicode();
+    auto ctu2 = font->getToUnicode();
+
+    if(!font->isCIDFont())
+    {
+        auto font1 = std::dynamic_pointer_cast<Gfx8BitFont>(primary);
+        auto font2 = std::dynamic_pointer_cast<Gfx8BitFont>(font);
+        for(int code = 0; code < 0x100; ++code)
+        {
+            if(!used_map[code]) continue;
+
+            // glyphs of non-TrueType fonts are located by names
+            // those of TrueType fonts are located by code2GID, which is derived from the encoding
+            auto cn1 = font1->getCharName(code);
+            auto cn2 = font2->getCharName(code);
+            if((cn1 == nullptr) != (cn2 == nullptr))
+                return false;
+            if(cn1 && strcmp(cn1, cn2))
+                return false;
+
+            if(!equal(font1->getWidth(code), font2->getWidth(code)))
+                return false;
+
+            if(!same_unicode_mapping(ctu1, ctu2, code))
+                return false;
+        }
+    }
+    else
+    {
+        auto font1 = std::dynamic_pointer_cast<GfxCIDFont>(primary);
+        auto font2 = std::dynamic_pointer_cast<GfxCIDFont>(font);
+
+        int len1 = font1->getCIDToGIDLen();
+        int len2 = font2->getCIDToGIDLen();
+        if(len1 != len2)
+            return false;
+        if((len1 > 0) && !std::equal(font1->getCIDToGID(), font1->getCIDToGID() + len1, font2->getCIDToGID()))
+            return false;
+
+        for(int code = 0; code < 0x10000; ++code)
+        {
+            if(!used_map[code]) continue;
+
+            char buf[2];
+            buf[0] = (code >> 8) & 0xff;
+            buf[1] = (code & 0xff);
+            if(!equal(font1->getWidth(buf, 2), font2->getWidth(buf, 2)))
+                return false;
+
+            if(!same_unicode_mapping(ctu1, ctu2, code))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+void HTMLRenderer::detect_duplicate_fonts(void)
+{
+    // the type and the content of the font program, throw 0 upon failure
+    auto read_font_program = [this](const std::shared_ptr<GfxFont> & font) {
+        string suffix;
+        Object obj = get_embedded_font_stream(font, suffix);
+        string content = suffix + '\0';
+
+        obj.streamReset();
+        char buf[1024];
+        int len;
+        while((len = obj.streamGetChars(1024, (unsigned char*)buf)) > 0)
+        {
+            content.append(buf, len);
+        }
+        obj.streamClose();
+        return content;
+    };
+
+    // content hash of the font program -> fonts that will be actually embedded
+    unordered_map<uint64_t, std::vector<std::shared_ptr<GfxFont>>> primary_fonts;
+
+    for(auto & p : preprocessor.get_fonts())
+    {
+        const auto & font = p.second;
+
+        // Type 3 fonts are generated from glyph procedures, not loaded from font programs
+        if((font->getType() == fontType3) || font->getWMode())
+            continue;
+
+        auto font_loc = font->locateFont(xref, nullptr);
+        if((!font_loc) || (font_loc->locType != gfxFontLocEmbedded))
+            continue;
+
+        // the name is not compared, identical programs may have different subset tags
+        string content;
+        try
+        {
+            content = read_font_program(font);
+        }
+        catch(int)
+        {
+            // will be reported later in dump_embedded_font
+            continue;
+        }
+
+        ContentHash content_hash;
+        content_hash.update(content);
+
+        auto & candidates = primary_fonts[content_hash.get()];
+        bool merged = false;
+        for(auto & primary : candidates)
+        {
+            if(!is_font_compatible(primary, font, preprocessor.get_code_map(p.first)))
+                continue;
+
+            // the hash is only a hint, read the primary font again to be sure
+            try
+            {
+                if(read_font_program(primary) != content)
+                    continue;
+            }
+            catch(int)
+            {
+                continue;
+            }
+
+            long long primary_id = hash_ref(primary->getID());
+            preprocessor.merge_code_map(primary_id, p.first);
+            font_alias_map.insert(make_pair(p.first, primary));
+            merged = true;
+
+            if(param.debug)
+            {
+                cerr << "Merge duplicate font (" << (font->getID()->num) << ' ' << (font->getID()->gen) << ")"
+                    << " into (" << (primary->getID()->num) << ' ' << (primary->getID()->gen) << ") "
+                    << (font->getName() ? font->getName()->c_str() : "")
+                    << endl;
+            }
+            break;
+        }
+
+        if(!merged)
+            candidates.push_back(font);
+    }
+}
+
 const FontInfo * HTMLRenderer::install_font(const std::shared_ptr<GfxFont> font)
 {
     assert(sizeof(long long) == 2*sizeof(int));
                 
     long long fn_id = (font == nullptr) ? 0 : hash_ref(font->getID());
 
+    if(page_cache.enabled())
+        cur_page_fonts.insert(make_pair(fn_id, font));
+
     auto iter = font_info_map.find(fn_id);
     if(iter != font_info_map.end())
         return &(iter->second);
 
-    long long new_fn_id = font_info_map.size(); 
+    // duplicated fonts share the web font of the one they are merged into
+    auto alias_iter = font_alias_map.find(fn_id);
+    if(alias_iter != font_alias_map.end())
+    {
+        const FontInfo * primary_info = install_font(alias_iter->second);
+        return &(font_info_map.insert(make_pair(fn_id, *primary_info)).first->second);
+    }
+
+    // keep the ids of the previous conversion, which are used by cached pages
+    long long new_fn_id = page_cache.enabled()
+        ? page_cache.get_font_id(page_cache.hash_font(font))
+        : font_info_map.size();
 
     auto cur_info_iter = font_info_map.insert(make_pair(fn_id, FontInfo())).first;
 
@@ -50,7 +50,11 @@ HTMLRenderer::HTMLRenderer(const char* progPath, Param & param)
     ,html_text_page(param, all_manager)
     ,preprocessor(param)
     ,tmp_files(param)
+    ,stats(param)
+    ,page_cache(param)
+    ,checkpoint(param)
     ,covered_text_detector(param)
+    ,dpi_policy(param)
     ,tracer(param)
 {
     if(!(param.debug))
@@ -61,6 +65,9 @@ HTMLRenderer::HTMLRenderer(const char* progPath, Param & param)
 
     ffw_init(progPath, param.debug);
 
+    // files referred by the checkpoint are needed when resuming
+    tmp_files.set_keep(checkpoint.enabled());
+
     cur_mapping.resize(0x10000);
     cur_mapping2.resize(0x100);
     width_list.resize(0x10000);
@@ -97,18 +104,20 @@ HTMLRenderer::~HTMLRenderer()
     ffw_finalize();
 }
 
-#define MAX_DIMEN 9000
-
-
-
 void HTMLRenderer::process(PDFDoc *doc)
 {
     cur_doc = doc;
     cur_catalog = doc->getCatalog();
     xref = doc->getXRef();
 
+    if(checkpoint.enabled())
+        init_checkpoint();
+
     pre_process(doc);
 
+    if(page_cache.enabled())
+        init_page_cache(doc);
+
     /* get outline records */
     if (doc && doc->getOutline()) {
         dump_outline(&outline_recs, doc->getOutline()->getItems(), param.first_page, param.last_page, 1);
@@ -135,15 +144,24 @@ void HTMLRenderer::process(PDFDoc *doc)
     }
 
     int page_count = (param.last_page - param.first_page + 1);
-    for(int i = param.first_page; i <= param.last_page ; ++i)
+    dpi_policy.init(page_count);
+
+    int start_page = param.first_page;
+    if(checkpoint.is_resuming())
+    {
+        restore_checkpoint();
+        start_page = checkpoint.get_state()["next_page"].asInt();
+    }
+    else if(!param.serve.empty())
     {
-        param.actual_dpi = param.desired_dpi;
-        param.max_dpi = 72 * MAX_DIMEN / max(doc->getPageCropWidth(i), doc->getPageCropHeight(i));
+        // pages are converted on demand, see serve()
+        dump_empty_frames();
+        start_page = param.last_page + 1;
+    }
 
-        if (param.actual_dpi > param.max_dpi) {
-            param.actual_dpi = param.max_dpi;
-            printf("Warning:Page %d clamped to %f DPI\n", i, param.actual_dpi);
-        }
+    for(int i = start_page; i <= param.last_page ; ++i)
+    {
+        dpi_policy.begin_page(doc, i);
 
         if (param.tmp_file_size_limit != -1 && tmp_files.get_total_size() > param.tmp_file_size_limit * 1024) {
             if(param.quiet == 0)
@@ -162,35 +180,10 @@ void HTMLRenderer::process(PDFDoc *doc)
           cerr << endl;
         }
 
-        if (param.split_pages) {
-            // copy the string out, since we will reuse the buffer soon
-            string filled_template_filename = (char*)str_fmt(param.page_filename.c_str(), i);
-            auto page_fn = str_fmt("%s/%s", param.dest_dir.c_str(), filled_template_filename.c_str());
-            f_curpage = new ofstream((char*)page_fn, ofstream::binary);
-            if(!(*f_curpage))
-                throw string("Cannot open ") + (char*)page_fn + " for writing";
-            set_stream_flags((*f_curpage));
+        process_page(doc, i);
 
-            cur_page_filename = filled_template_filename;
-        }
-
-        doc->displayPage(this, i,
-                text_zoom_factor() * DEFAULT_DPI, text_zoom_factor() * DEFAULT_DPI,
-                0,
-                (!(param.use_cropbox)),
-                true,  // crop
-                false, // printing
-                nullptr, nullptr, nullptr, nullptr);
-
-        if (param.desired_dpi != param.actual_dpi) {
-            printf("Page %d DPI change %.1f => %.1f\n", i, param.desired_dpi, param.actual_dpi);
-        }
-
-        if(param.split_pages)
-        {
-            delete f_curpage;
-            f_curpage = nullptr;
-        }
+        if(checkpoint.enabled() && checkpoint.is_due(i))
+            save_checkpoint(i + 1);
     }
     if(page_count >= 0 && param.quiet == 0) {
       cerr << "Working: " << page_count << "/" << page_count;
@@ -212,6 +205,18 @@ void HTMLRenderer::process(PDFDoc *doc)
 
     post_process();
 
+    if(page_cache.enabled())
+        page_cache.save(all_manager, f_pages.path);
+
+    if(checkpoint.enabled())
+    {
+        checkpoint.finish();
+        tmp_files.set_keep(false);
+    }
+
+    if(!param.serve.empty())
+        serve();
+
     bg_renderer = nullptr;
     fallback_bg_renderer = nullptr;
 
@@ -219,6 +224,56 @@ void HTMLRenderer::process(PDFDoc *doc)
         cerr << endl;
 }
 
+void HTMLRenderer::process_page(PDFDoc * doc, int pageno)
+{
+    string page_path;
+    if (param.split_pages) {
+        // copy the string out, since we will reuse the buffer soon
+        string filled_template_filename = (char*)str_fmt(param.page_filename.c_str(), pageno);
+        page_path = (char*)str_fmt("%s/%s", param.dest_dir.c_str(), filled_template_filename.c_str());
+        f_curpage = new ofstream(page_path, ofstream::binary);
+        if(!(*f_curpage))
+            throw string("Cannot open ") + page_path + " for writing";
+        stats.add_output_file(page_path);
+        set_stream_flags((*f_curpage));
+
+        cur_page_filename = filled_template_filename;
+    }
+
+    ContentHash page_hash;
+    long long frame_begin = 0;
+    if(page_cache.enabled())
+    {
+        page_hash = hash_page(pageno);
+        frame_begin = f_pages.fs.tellp();
+        cur_page_fonts.clear();
+        cur_page_files.clear();
+    }
+
+    if(!(page_cache.enabled() && reuse_cached_page(pageno, page_hash)))
+    {
+        Stats::Timer timer(stats, "display_page", pageno);
+        doc->displayPage(this, pageno,
+                text_zoom_factor() * DEFAULT_DPI, text_zoom_factor() * DEFAULT_DPI,
+                0,
+                (!(param.use_cropbox)),
+                true,  // crop
+                false, // printing
+                nullptr, nullptr, nullptr, nullptr);
+    }
+
+    dpi_policy.end_page();
+
+    if(page_cache.enabled())
+        cache_page(pageno, page_hash, frame_begin, page_path);
+
+    if(param.split_pages)
+    {
+        delete f_curpage;
+        f_curpage = nullptr;
+    }
+}
+
 void HTMLRenderer::setDefaultCTM(const double *ctm)
 {
     memcpy(default_ctm, ctm, sizeof(default_ctm));
@@ -256,37 +311,66 @@ void HTMLRenderer::endPage() {
     /*
      * When split_pages is on, f_curpage points to the current page file
      * and we want to output empty frames in f_pages.fs
+     *
+     * When serving, all empty frames have been written before
      */
-    if(param.split_pages)
-    {
-        f_pages.fs
-            << "<div id=\"" << CSS::PAGE_FRAME_CN << pageNum
-                << "\" class=\"" << CSS::PAGE_FRAME_CN
-                << " " << CSS::WIDTH_CN << wid
-                << " " << CSS::HEIGHT_CN << hid
-                << "\" data-page-no=\"" << pageNum
-                << "\" data-page-url=\"";
-
-        writeAttribute(f_pages.fs, cur_page_filename);
-        f_pages.fs << "\">";
-    }
+    bool dump_frame = param.split_pages && param.serve.empty();
+    if(dump_frame)
+        dump_empty_frame(pageNum, wid, hid, cur_page_filename);
 
     if(param.process_nontext)
     {
-        if (bg_renderer->render_page(cur_doc, pageNum))
+        if (covered_text_detector.has_partially_covered_chars())
+            dpi_policy.require_text_dpi();
+
+        BackgroundRenderer * renderer = nullptr;
         {
-            bg_renderer->embed_image(pageNum);
+            Stats::Timer timer(stats, "bg_render", pageNum);
+            if (bg_renderer->render_page(cur_doc, pageNum))
+                renderer = bg_renderer.get();
+            else if (fallback_bg_renderer && fallback_bg_renderer->render_page(cur_doc, pageNum))
+                renderer = fallback_bg_renderer.get();
         }
-        else if (fallback_bg_renderer)
+
+        if (renderer)
         {
-            if (fallback_bg_renderer->render_page(cur_doc, pageNum))
-                fallback_bg_renderer->embed_image(pageNum);
+            Stats::Timer timer(stats, "bg_encode", pageNum);
+            renderer->embed_image(pageNum);
+            // shown in the empty frame until the page is loaded
+            if(dump_frame && (param.bg_preview_dpi > 0))
+                renderer->embed_preview(f_pages.fs, pageNum);
+        }
+
+        if(param.debug && param.correct_text_visibility)
+        {
+            auto counters = covered_text_detector.get_counters();
+            cerr << "Page " << pageNum << " chars drawn: " << counters.drawn
+                 << ", covered: " << counters.covered
+                 << ", partially covered: " << counters.partially_covered << endl;
         }
     }
 
     // dump all text
-    html_text_page.dump_text(*f_curpage, cur_doc, pageNum, &outline_recs);
-    html_text_page.dump_css(f_css.fs);
+    {
+        Stats::Timer timer(stats, "dump_text", pageNum);
+        html_text_page.dump_text(*f_curpage, cur_doc, pageNum, &outline_recs);
+    }
+    {
+        Stats::Timer timer(stats, "dump_css", pageNum);
+        html_text_page.dump_css(f_css.fs);
+    }
+    if(stats.enabled())
+    {
+        // lines are merged in dump_text
+        for(auto * line : html_text_page.get_lines())
+        {
+            stats.add_count("glyphs", line->get_glyph_count());
+            stats.add_count("states", line->get_state_count());
+            stats.add_count("offsets", line->get_offset_count());
+        }
+        stats.add_count("lines", html_text_page.get_lines().size());
+        stats.add_count("pages", 1);
+    }
     html_text_page.clear();
 
     // process form
@@ -322,16 +406,63 @@ void HTMLRenderer::endPage() {
     // close page
     (*f_curpage) << "</div>" << endl;
 
-    if(param.split_pages)
+    if(dump_frame)
     {
         f_pages.fs << "</div>" << endl;
     }
 }
 
+void HTMLRenderer::dump_empty_frame(int pageno, long long wid, long long hid, const string & page_filename)
+{
+    f_pages.fs
+        << "<div id=\"" << CSS::PAGE_FRAME_CN << pageno
+            << "\" class=\"" << CSS::PAGE_FRAME_CN
+            << " " << CSS::WIDTH_CN << wid
+            << " " << CSS::HEIGHT_CN << hid
+            << "\" data-page-no=\"" << pageno
+            << "\" data-page-url=\"";
+
+    writeAttribute(f_pages.fs, page_filename);
+    f_pages.fs << "\">";
+}
+
+string HTMLRenderer::get_options_fingerprint(void)
+{
+    // options that do not affect the output
+    Param p = param;
+    p.input_filename = "";
+    p.dest_dir = "";
+    p.tmp_dir = "";
+    p.clean_tmp = 0;
+    p.owner_password = "";
+    p.user_password = "";
+    p.actual_dpi = 0;
+    p.max_dpi = 0;
+    p.quiet = 0;
+    p.memstat = 0;
+    p.page_cache = "";
+    p.checkpoint_dir = "";
+    p.checkpoint_interval = 0;
+    p.resume = 0;
+    p.stats_json = "";
+    p.trace_file = "";
+
+    std::ostringstream out;
+    out.precision(17);
+    p.dump(out);
+    out << PDF2HTMLEX_VERSION;
+    return out.str();
+}
+
 void HTMLRenderer::pre_process(PDFDoc * doc)
 {
+    Stats::Timer timer(stats, "preprocess");
+
     preprocessor.process(doc);
 
+    if(param.merge_duplicate_fonts)
+        detect_duplicate_fonts();
+
     /*
      * determine scale factors
      */
@@ -376,9 +507,11 @@ void HTMLRenderer::pre_process(PDFDoc * doc)
 
         if(param.embed_css)
             tmp_files.add((char*)fn);
+        else
+            stats.add_output_file((char*)fn);
 
         f_css.path = (char*)fn;
-        f_css.fs.open(f_css.path, ofstream::binary);
+        open_output(f_css.fs, f_css.path, "css");
         if(!f_css.fs)
             throw string("Cannot open ") + (char*)fn + " for writing";
         set_stream_flags(f_css.fs);
@@ -396,6 +529,8 @@ void HTMLRenderer::pre_process(PDFDoc * doc)
 
         if(param.embed_outline)
             tmp_files.add((char*)fn);
+        else
+            stats.add_output_file((char*)fn);
 
         f_outline.path = (char*)fn;
         f_outline.fs.open(f_outline.path, ofstream::binary);
@@ -417,7 +552,7 @@ void HTMLRenderer::pre_process(PDFDoc * doc)
         tmp_files.add((char*)fn);
 
         f_pages.path = (char*)fn;
-        f_pages.fs.open(f_pages.path, ofstream::binary);
+        open_output(f_pages.fs, f_pages.path, "pages");
         if(!f_pages.fs)
             throw string("Cannot open ") + (char*)fn + " for writing";
         set_stream_flags(f_pages.fs);
@@ -435,6 +570,8 @@ void HTMLRenderer::pre_process(PDFDoc * doc)
 
 void HTMLRenderer::post_process(void)
 {
+    Stats::Timer timer(stats, "post_process");
+
     dump_css();
     
     // close files if they opened
@@ -452,6 +589,7 @@ void HTMLRenderer::post_process(void)
         output.open((char*)fn, ofstream::binary);
         if(!output)
             throw string("Cannot open ") + (char*)fn + " for writing";
+        stats.add_output_file((char*)fn);
         set_stream_flags(output);
     }
 
@@ -550,40 +688,45 @@ void HTMLRenderer::set_stream_flags(std::ostream & out)
 
 void HTMLRenderer::dump_css (void)
 {
-    all_manager.transform_matrix.dump_css(f_css.fs);
-    all_manager.vertical_align  .dump_css(f_css.fs);
-    all_manager.letter_space    .dump_css(f_css.fs);
-    all_manager.stroke_color    .dump_css(f_css.fs);
-    all_manager.word_space      .dump_css(f_css.fs);
-    all_manager.whitespace      .dump_css(f_css.fs);
-    all_manager.fill_color      .dump_css(f_css.fs);
-    all_manager.font_size       .dump_css(f_css.fs);
-    all_manager.bottom          .dump_css(f_css.fs);
-    all_manager.height          .dump_css(f_css.fs);
-    all_manager.width           .dump_css(f_css.fs);
-    all_manager.left            .dump_css(f_css.fs);
-    all_manager.bgimage_size    .dump_css(f_css.fs);
+    // classes dumped before are skipped, see serve()
+    const AllStateSizes & d = dumped_css_sizes;
+
+    all_manager.transform_matrix.dump_css(f_css.fs, d.transform_matrix);
+    all_manager.vertical_align  .dump_css(f_css.fs, d.vertical_align);
+    all_manager.letter_space    .dump_css(f_css.fs, d.letter_space);
+    all_manager.stroke_color    .dump_css(f_css.fs, d.stroke_color);
+    all_manager.word_space      .dump_css(f_css.fs, d.word_space);
+    all_manager.whitespace      .dump_css(f_css.fs, d.whitespace);
+    all_manager.fill_color      .dump_css(f_css.fs, d.fill_color);
+    all_manager.font_size       .dump_css(f_css.fs, d.font_size);
+    all_manager.bottom          .dump_css(f_css.fs, d.bottom);
+    all_manager.height          .dump_css(f_css.fs, d.height);
+    all_manager.width           .dump_css(f_css.fs, d.width);
+    all_manager.left            .dump_css(f_css.fs, d.left);
+    all_manager.bgimage_size    .dump_css(f_css.fs, d.bgimage_size);
 
     // print css
     if(param.printing)
     {
         double ps = print_scale();
         f_css.fs << CSS::PRINT_ONLY << "{" << endl;
-        all_manager.transform_matrix.dump_print_css(f_css.fs, ps);
-        all_manager.vertical_align  .dump_print_css(f_css.fs, ps);
-        all_manager.letter_space    .dump_print_css(f_css.fs, ps);
-        all_manager.stroke_color    .dump_print_css(f_css.fs, ps);
-        all_manager.word_space      .dump_print_css(f_css.fs, ps);
-        all_manager.whitespace      .dump_print_css(f_css.fs, ps);
-        all_manager.fill_color      .dump_print_css(f_css.fs, ps);
-        all_manager.font_size       .dump_print_css(f_css.fs, ps);
-        all_manager.bottom          .dump_print_css(f_css.fs, ps);
-        all_manager.height          .dump_print_css(f_css.fs, ps);
-        all_manager.width           .dump_print_css(f_css.fs, ps);
-        all_manager.left            .dump_print_css(f_css.fs, ps);
-        all_manager.bgimage_size    .dump_print_css(f_css.fs, ps);
+        all_manager.transform_matrix.dump_print_css(f_css.fs, ps, d.transform_matrix);
+        all_manager.vertical_align  .dump_print_css(f_css.fs, ps, d.vertical_align);
+        all_manager.letter_space    .dump_print_css(f_css.fs, ps, d.letter_space);
+        all_manager.stroke_color    .dump_print_css(f_css.fs, ps, d.stroke_color);
+        all_manager.word_space      .dump_print_css(f_css.fs, ps, d.word_space);
+        all_manager.whitespace      .dump_print_css(f_css.fs, ps, d.whitespace);
+        all_manager.fill_color      .dump_print_css(f_css.fs, ps, d.fill_color);
+        all_manager.font_size       .dump_print_css(f_css.fs, ps, d.font_size);
+        all_manager.bottom          .dump_print_css(f_css.fs, ps, d.bottom);
+        all_manager.height          .dump_print_css(f_css.fs, ps, d.height);
+        all_manager.width           .dump_print_css(f_css.fs, ps, d.width);
+        all_manager.left            .dump_print_css(f_css.fs, ps, d.left);
+        all_manager.bgimage_size    .dump_print_css(f_css.fs, ps, d.bgimage_size);
         f_css.fs << "}" << endl;
     }
+
+    dumped_css_sizes = all_manager.get_sizes();
 }
 
 void HTMLRenderer::embed_file(ostream & out, const string & path, const string & type, bool copy)
@@ -633,6 +776,7 @@ void HTMLRenderer::embed_file(ostream & out, const string & path, const string &
             ofstream out(out_path, ofstream::binary);
             if(!out)
                 throw string("Cannot open file ") + path + " for embedding";
+            stats.add_output_file(out_path);
             out << fin.rdbuf();
             out.clear(); // out will set fail big if fin is empty
         }
@@ -679,21 +823,12 @@ void HTMLRenderer::dump_outline(std::map<int, std::vector<OutlineRec>> *outline,
             if (act && act->getKind() == LinkActionKind::actionGoTo)   {
 
                 auto * link =  dynamic_cast<const LinkGoTo*>(act);
-                std::unique_ptr<LinkDest> dest = nullptr;
-                if(auto _ = link->getDest()) {
-                    dest = std::unique_ptr<LinkDest>(new LinkDest(*_));
-                } else if (auto _ = link->getNamedDest()) {
-                    dest = cur_catalog->findDest(_);
-                }
+                DestInfo buf;
+                auto * info = find_dest(link, buf);
 
-                if (dest) {
-                    int pagenum = 0;
-                    if (dest->isPageRef()) {
-                        auto pageref = dest->getPageRef();
-                        pagenum = cur_catalog->findPage(pageref);
-                    } else {
-                        pagenum = dest->getPageNum();
-                    }
+                if (info) {
+                    const LinkDest * dest = info->dest.get();
+                    int pagenum = info->pageno;
 
                     if (pagenum >= firstpage && pagenum <= lastpage) {
                         OutlineRec rec {0.000001, 0.000001};
@@ -709,7 +844,6 @@ void HTMLRenderer::dump_outline(std::map<int, std::vector<OutlineRec>> *outline,
                         (*outline)[pagenum].push_back(rec);
                         //printf("get outline record: x=%f top=%f bottom=%f l=%d pagenum=%d title=%s\n", rec.left, rec.top, rec.bottom, deep, pagenum, rec.title.c_str());
                     }
-                    dest.reset();
                 }
             }
             
@@ -865,7 +999,32 @@ void HTMLRenderer::dump_tags(const std::string &filename)
 
 }
 
+void HTMLRenderer::dump_stats(void)
+{
+    if(!stats.enabled())
+        return;
 
-
+    stats.set_count("css_classes.transform_matrix", all_manager.transform_matrix.size());
+    stats.set_count("css_classes.vertical_align",   all_manager.vertical_align  .size());
+    stats.set_count("css_classes.letter_space",     all_manager.letter_space    .size());
+    stats.set_count("css_classes.stroke_color",     all_manager.stroke_color    .size());
+    stats.set_count("css_classes.word_space",       all_manager.word_space      .size());
+    stats.set_count("css_classes.whitespace",       all_manager.whitespace      .size());
+    stats.set_count("css_classes.fill_color",       all_manager.fill_color      .size());
+    stats.set_count("css_classes.font_size",        all_manager.font_size       .size());
+    stats.set_count("css_classes.bottom",           all_manager.bottom          .size());
+    stats.set_count("css_classes.height",           all_manager.height          .size());
+    stats.set_count("css_classes.width",            all_manager.width           .size());
+    stats.set_count("css_classes.left",             all_manager.left            .size());
+    stats.set_count("css_classes.bgimage_size",     all_manager.bgimage_size    .size());
+    // merged duplicate fonts share the web font of another one
+    long long font_count = 0;
+    for(auto & p : font_info_map)
+        if(font_alias_map.count(p.first) == 0)
+            ++font_count;
+    stats.set_count("fonts", font_count);
+
+    stats.dump();
+}
 
 }// namespace pdf2htmlEX
@@ -34,23 +34,8 @@ using std::endl;
  * The string will be put into a HTML attribute, surrounded by single quotes
  * So pay attention to the characters used here
  */
-static string get_linkdest_detail_str(
-  LinkDest * dest,   // borrow the caller's std::unique_ptr
-  Catalog * catalog,
-  int & pageno
-)
+static string get_linkdest_detail_str(const LinkDest * dest, int pageno)
 {
-    pageno = 0;
-    if(dest->isPageRef())
-    {
-        auto pageref = dest->getPageRef();
-        pageno = catalog->findPage(pageref);
-    }
-    else
-    {
-        pageno = dest->getPageNum();
-    }
-
     if(pageno <= 0)
     {
         return "";
@@ -146,25 +131,14 @@ string HTMLRenderer::get_linkaction_str(
                 {
                     auto * real_action = 
                         dynamic_cast<const LinkGoTo*>(action);
-                    std::unique_ptr<LinkDest> dest = nullptr;
-                    if(auto _ = real_action->getDest()) {
-                        dest = std::unique_ptr<LinkDest>(new LinkDest(*_));
-                    }
-                    else if (auto _ = real_action->getNamedDest())
-                        dest = cur_catalog->findDest(_);
-                    if(dest)
+                    DestInfo buf;
+                    auto * info = find_dest(real_action, buf);
+                    if(info && (info->pageno > 0))
                     {
-                        int pageno = 0;
-                        detail = get_linkdest_detail_str(
-                            dest.get(), cur_catalog, pageno
+                        detail = info->detail;
+                        dest_str = (char*)str_fmt(
+                          "#%s%x", CSS::PAGE_FRAME_CN, info->pageno
                         );
-                        if(pageno > 0)
-                        {
-                            dest_str = (char*)str_fmt(
-                              "#%s%x", CSS::PAGE_FRAME_CN, pageno
-                            );
-                        }
-                        dest.reset();
                     }
                 }
                 break;
@@ -193,6 +167,50 @@ string HTMLRenderer::get_linkaction_str(
 
     return dest_str;
 }
+
+const HTMLRenderer::DestInfo * HTMLRenderer::find_dest(const LinkGoTo * action, DestInfo & buf)
+{
+    DestInfo * info = nullptr;
+    if(auto _ = action->getDest())
+    {
+        info = &buf;
+        info->dest = std::unique_ptr<LinkDest>(new LinkDest(*_));
+    }
+    else if(auto _ = action->getNamedDest())
+    {
+        // documents may refer to the same name many times
+        auto p = named_dests.emplace(_->toStr(), DestInfo());
+        info = &(p.first->second);
+        if(!p.second)
+            return info->dest ? info : nullptr;
+        info->dest = cur_catalog->findDest(_);
+    }
+
+    if(!info || !info->dest)
+        return nullptr;
+
+    const LinkDest * dest = info->dest.get();
+    info->pageno = dest->isPageRef() ? find_page(dest->getPageRef()) : dest->getPageNum();
+    info->detail = get_linkdest_detail_str(dest, info->pageno);
+    return info;
+}
+
+int HTMLRenderer::find_page(const Ref & ref)
+{
+    // Catalog::findPage scans all the pages for each call
+    if(page_refs.empty())
+    {
+        for(int i = 1; i <= cur_catalog->getNumPages(); ++i)
+        {
+            // the first page wins, as in Catalog::findPage
+            if(auto r = cur_catalog->getPageRef(i))
+                page_refs.insert(make_pair(hash_ref(r), i));
+        }
+    }
+
+    auto iter = page_refs.find(hash_ref(&ref));
+    return (iter == page_refs.end()) ? 0 : iter->second;
+}
     
 /*
  * Based on pdftohtml from poppler
@@ -0,0 +1,245 @@
+/*
+ * serve.cc
+ *
+ * Convert pages on demand, see --serve
+ */
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#ifndef __MINGW32__
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "HTMLRenderer.h"
+#include "util/namespace.h"
+#include "util/path.h"
+
+namespace pdf2htmlEX {
+
+using std::cerr;
+using std::istringstream;
+using std::ostringstream;
+
+#ifndef __MINGW32__
+static bool send_all(int fd, const string & s)
+{
+    size_t sent = 0;
+    while(sent < s.size())
+    {
+        // do not get killed by SIGPIPE if the client is gone
+        ssize_t len = send(fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+        if(len < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += len;
+    }
+    return true;
+}
+#endif //__MINGW32__
+
+void HTMLRenderer::dump_empty_frames(void)
+{
+    for(int i = param.first_page; i <= param.last_page; ++i)
+    {
+        Page * page = cur_doc->getPage(i);
+        if(!page)
+            continue;
+
+        // the same size as the GfxState created by displayPage
+        const PDFRectangle * box = param.use_cropbox ? page->getCropBox() : page->getMediaBox();
+        double width = (box->x2 - box->x1) * text_zoom_factor();
+        double height = (box->y2 - box->y1) * text_zoom_factor();
+        if(page->getRotate() % 180 != 0)
+            std::swap(width, height);
+
+        string page_filename = (char*)str_fmt(param.page_filename.c_str(), i);
+        dump_empty_frame(i, all_manager.width.install(width), all_manager.height.install(height), page_filename);
+        f_pages.fs << "</div>" << endl;
+    }
+}
+
+void HTMLRenderer::serve(void)
+{
+#ifdef __MINGW32__
+    // Unix domain sockets are not available, --serve is rejected by check_param
+    throw string("--serve is not supported on this platform");
+#else
+    // classes and fonts installed after the main HTML file is built
+    string delta_filename = param.css_filename;
+    if(get_suffix(delta_filename) == ".css")
+        delta_filename.resize(delta_filename.size() - 4);
+    delta_filename += ".delta.css";
+
+    f_css.path = (char*)str_fmt("%s/%s", param.dest_dir.c_str(), delta_filename.c_str());
+    f_css.fs.open(f_css.path, ofstream::binary);
+    if(!f_css.fs)
+        throw string("Cannot open ") + f_css.path + " for writing";
+    stats.add_output_file(f_css.path);
+    set_stream_flags(f_css.fs);
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(param.serve.size() >= sizeof(addr.sun_path))
+        throw string("Socket path is too long: ") + param.serve;
+    strcpy(addr.sun_path, param.serve.c_str());
+
+    // a socket left by a previous run, never remove anything else
+    struct stat st;
+    if(lstat(param.serve.c_str(), &st) == 0)
+    {
+        if(!S_ISSOCK(st.st_mode))
+            throw string("Cannot listen on ") + param.serve + ": the file exists and is not a socket";
+        unlink(param.serve.c_str());
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server < 0)
+        throw string("Cannot create socket: ") + strerror(errno);
+    if((bind(server, (sockaddr*)&addr, sizeof(addr)) < 0) || (listen(server, 1) < 0))
+    {
+        string error = strerror(errno);
+        close(server);
+        throw string("Cannot listen on ") + param.serve + ": " + error;
+    }
+
+    if(param.quiet == 0)
+        cerr << "Serving pages on " << param.serve << endl;
+
+    bool quit = false;
+    while(!quit)
+    {
+        int client = accept(server, nullptr, nullptr);
+        if(client < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            cerr << "Warning: cannot accept connections: " << strerror(errno) << endl;
+            break;
+        }
+
+        // one request per line, until the client closes the connection
+        string buf;
+        char chunk[256];
+        ssize_t len;
+        bool connected = true;
+        while(connected && !quit && ((len = read(client, chunk, sizeof(chunk))) > 0))
+        {
+            buf.append(chunk, len);
+            size_t pos;
+            while(connected && !quit && ((pos = buf.find('\n')) != string::npos))
+            {
+                string request = buf.substr(0, pos);
+                buf.erase(0, pos + 1);
+                connected = send_all(client, serve_request(request, quit));
+            }
+        }
+        close(client);
+    }
+
+    close(server);
+    unlink(param.serve.c_str());
+#endif //__MINGW32__
+}
+
+/*
+ * Remove what process_page has written for a failed page, such that a client never
+ * loads a partial page file
+ */
+void HTMLRenderer::discard_page(int pageno)
+{
+    delete f_curpage;
+    f_curpage = nullptr;
+
+    // copy the string out, since str_fmt reuses its buffer
+    string page_filename = (char*)str_fmt(param.page_filename.c_str(), pageno);
+    remove((param.dest_dir + "/" + page_filename).c_str());
+}
+
+/*
+ * Requests:
+ *   page <page number>
+ *     ok <page file> <delta stylesheet> <begin> <end>
+ *     where [begin, end) of the delta stylesheet is needed by the page, and not sent before
+ *   quit
+ *     ok
+ *
+ * Any failure is replied with "error <message>"
+ */
+string HTMLRenderer::serve_request(const string & request, bool & quit)
+{
+    istringstream in(request);
+    string command;
+    in >> command;
+
+    if(command == "quit")
+    {
+        quit = true;
+        return "ok\n";
+    }
+
+    if(command != "page")
+        return "error unknown request\n";
+
+    int pageno;
+    if(!(in >> pageno) || (pageno < param.first_page) || (pageno > param.last_page))
+        return "error invalid page number\n";
+
+    long long css_begin = f_css.fs.tellp();
+    if(served_pages.insert(pageno).second)
+    {
+        // the renderer may also throw const char * and int
+        bool failed = true;
+        string error;
+        try
+        {
+            dpi_policy.begin_page(cur_doc, pageno);
+            process_page(cur_doc, pageno);
+            dump_css();
+            f_css.fs.flush();
+            failed = false;
+        }
+        catch(const string & s)
+        {
+            error = s;
+        }
+        catch(const char * s)
+        {
+            error = s;
+        }
+        catch(...)
+        {
+            error = "unknown error";
+        }
+
+        if(failed)
+        {
+            served_pages.erase(pageno);
+            discard_page(pageno);
+            return "error " + error + "\n";
+        }
+
+        if(param.debug)
+            cerr << "Page " << pageno << " is served" << endl;
+    }
+    long long css_end = f_css.fs.tellp();
+
+    ostringstream reply;
+    reply << "ok " << (char*)str_fmt(param.page_filename.c_str(), pageno)
+          << ' ' << get_filename(f_css.path)
+          << ' ' << css_begin << ' ' << css_end << '\n';
+    return reply.str();
+}
+
+} // namespace pdf2htmlEX
@@ -191,7 +191,7 @@ void HTMLRenderer::drawString(GfxState * state, const GooString * s)
 
 bool HTMLRenderer::is_char_covered(int index)
 {
-    auto covered = covered_text_detector.get_chars_covered();
+    const auto & covered = covered_text_detector.get_chars_covered();
     if (index < 0 || index >= (int)covered.size())
     {
         std::cerr << "Warning: HTMLRenderer::is_char_covered: index out of bound: "
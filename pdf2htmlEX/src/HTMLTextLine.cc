@@ -148,42 +148,31 @@ void HTMLTextLine::dump_chars(ostream & out, int begin, int len)
 
 
 // dump outline
-void HTMLTextLine::dump_outline(std::ostream &out, OutlineRecMap *outline, int pagenum)
+void HTMLTextLine::dump_outline(std::ostream &out, const OutlineRecIndex *outline_index)
 {
-    if (outline && outline->find(pagenum) != outline->end()) {
-        OutlineRecVec& items = outline->find(pagenum)->second;
-        double z = param.zoom > 0.01 ? param.zoom : 1.;
-        // double fz = states[0].font_size * (72.0/param.text_dpi) * z;
-        // double line_left = line_state.x - clip_x1;
-        double line_top = line_state.y - clip_y1 ; //+ fz - clip_y1;
-
-        // out << " data-dbg=\"" << line_left  << " " << line_top   << " " << ascent << " " << descent << " " << line_left / z << " " << line_top / z << "\"";
-
-        // !!! use only vertical align
-        // !!! horizontal coords are wrong
-        //for (auto  i = items.begin(); i != items.end(); ++i) {
-        for (size_t j = 0; j < items.size(); j++) {
-            // ?? if (abs(line_left - out_left) < 5. && abs(line_top - out_top) < 5.) {
-            auto i = items[j];
-            if ( i.left < 0.0001 && i.top < 0.0001 && i.text.size() > 0) {
-                if (std::equal(i.text.begin(), i.text.end(), ucs4_text.begin())) {
-                    i.text.clear();
-                    out << " data-outline-level=\"H" << i.level << "\" data-outline-title=\"" << Base64Stream(i.title) << "\"";
-                }
-            } else {
-                //double out_left = i->left * z;
-                double out_top = i.top * z;
-                if (/*abs(line_left - out_left) < 5. && */ out_top >= (line_top - 5.) && out_top <= (line_top + ascent) && !i.used) {
-                    out << " data-outline-level=\"H" << i.level << "\" data-outline-title=\"" << Base64Stream(i.title) << "\"";
-                    items[j].used = true;
-                }
-            } 
-        }
+    if (!outline_index)
+        return;
+
+    // !!! use only vertical align
+    // !!! horizontal coords are wrong
+    double line_top = line_state.y - clip_y1;
+
+    std::vector<OutlineRec*> items;
+    outline_index->find_by_top(line_top - 5., line_top + ascent, items);
+    outline_index->find_by_text(ucs4_text, items);
+    // keep the order of the outline
+    std::sort(items.begin(), items.end());
+
+    for (auto i : items) {
+        if (i->used)
+            continue;
+        out << " data-outline-level=\"H" << i->level << "\" data-outline-title=\"" << Base64Stream(i->title) << "\"";
+        i->used = true;
     }
 }
 
 // dump_text
-void HTMLTextLine::dump_text(ostream & out, PDFDoc *doc, int pagenum, OutlineRecMap *outline_recs)
+void HTMLTextLine::dump_text(ostream & out, PDFDoc *doc, int pagenum, const OutlineRecIndex *outline_index)
 {
     /*
      * Each Line is an independent absolute positioned block
@@ -202,7 +191,7 @@ void HTMLTextLine::dump_text(ostream & out, PDFDoc *doc, int pagenum, OutlineRec
     {
         // open <div> for the current text line
         out << "<div" ;
-        dump_outline(out, outline_recs, pagenum);
+        dump_outline(out, outline_index);
 
         // dump tags
         if (mcitems.size() > 0) {
@@ -93,9 +93,13 @@ public:
     void append_padding_char() { text.push_back(0); }
     void append_offset(double width);
     void append_state(const HTMLTextState & text_state);
-    void dump_text(std::ostream & out, PDFDoc *doc, int pagenum, OutlineRecMap *outline_recs);
+    void dump_text(std::ostream & out, PDFDoc *doc, int pagenum, const OutlineRecIndex *outline_index);
 
     bool text_empty(void) const { return text.empty(); }
+    // for statistics, glyph count includes padding chars
+    size_t get_glyph_count(void) const { return text.size(); }
+    size_t get_state_count(void) const { return states.size(); }
+    size_t get_offset_count(void) const { return offsets.size(); }
     void clear(void);
 
     void clip(const HTMLClipState &);
@@ -122,7 +126,7 @@ private:
     /*
      * outline info processing
      */
-    void dump_outline(std::ostream &out, OutlineRecMap *outline, int pagenum);
+    void dump_outline(std::ostream &out, const OutlineRecIndex *outline_index);
 
     const Param & param;
     AllStateManager & all_manager;
@@ -55,6 +55,14 @@ void HTMLTextPage::dump_text(ostream & out, PDFDoc *doc, int pagenum, OutlineRec
     //push a dummy entry for convenience
     clips.emplace_back(page_box, text_lines.size());
 
+    // outline records of this page, looked up by each line
+    OutlineRecIndex outline_index;
+    OutlineRecVec * outline_items = nullptr;
+    if (outline_recs && outline_recs->find(pagenum) != outline_recs->end()) {
+        outline_items = &outline_recs->find(pagenum)->second;
+        outline_index.build(*outline_items, param.zoom > 0.01 ? param.zoom : 1.);
+    }
+
     Clip cur_clip(page_box, 0);
     bool has_clip = false;
     //std::ostringstream loc;
@@ -81,7 +89,7 @@ void HTMLTextPage::dump_text(ostream & out, PDFDoc *doc, int pagenum, OutlineRec
                 {
                     (*text_line_iter)->clip(cs);
                 }
-                (*text_line_iter)->dump_text(out, doc, pagenum, outline_recs);
+                (*text_line_iter)->dump_text(out, doc, pagenum, outline_items ? &outline_index : nullptr);
                 ++text_line_iter;
             }
             if(has_clip)
@@ -90,11 +98,10 @@ void HTMLTextPage::dump_text(ostream & out, PDFDoc *doc, int pagenum, OutlineRec
             }
         }
 
-        if (outline_recs && outline_recs->find(pagenum) != outline_recs->end()) {
+        if (outline_items) {
             // save outlines without coords
-            OutlineRecVec& items = outline_recs->find(pagenum)->second;
-            for (auto  i = items.begin(); i != items.end(); ++i) {
-                if ( i->left < 0.0001 && i->top < 0.0001 && i->text.size() > 0) {
+            for (auto  i = outline_items->begin(); i != outline_items->end(); ++i) {
+                if (i->match_by_text()) {
                     out << "<div style=\"display:none;\" "
                         << "data-outline-level=\"H" << i->level << "\" "
                         << "data-outline-title=\"" << Base64Stream(i->title) << "\" "
@@ -31,6 +31,7 @@ public:
     ~HTMLTextPage();
 
     HTMLTextLine * get_cur_line(void) const { return cur_line; }
+    const std::vector<HTMLTextLine*> & get_lines(void) const { return text_lines; }
 
     void dump_text(std::ostream & out, PDFDoc *doc, int pagenum, OutlineRecMap *outline_recs);
     void dump_css(std::ostream & out);
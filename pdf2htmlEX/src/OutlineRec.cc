@@ -1,5 +1,8 @@
 
+#include <algorithm>
+
 #include "OutlineRec.h"
+#include "util/hash.h"
 
 using namespace pdf2htmlEX;
 
@@ -9,4 +12,59 @@ void OutlineRec::add_text(const Unicode *u, int len)
         text.reserve(len);
         text.assign(u, u + len);
     }
-}
\ No newline at end of file
+}
+
+void OutlineRecIndex::build(OutlineRecVec & items, double zoom)
+{
+    by_top.clear();
+    by_prefix.clear();
+    prefix_lens.clear();
+
+    std::vector<Unicode> prefix;
+    for (auto & rec : items) {
+        if (rec.match_by_text()) {
+            size_t len = std::min(rec.text.size(), PREFIX_LEN);
+            prefix.assign(rec.text.begin(), rec.text.begin() + len);
+            by_prefix.insert(std::make_pair(hash_prefix(prefix.data(), len), &rec));
+            if (std::find(prefix_lens.begin(), prefix_lens.end(), len) == prefix_lens.end())
+                prefix_lens.push_back(len);
+        } else {
+            by_top.push_back(std::make_pair(rec.top * zoom, &rec));
+        }
+    }
+
+    // stable, such that matches are found in the order of the outline
+    std::stable_sort(by_top.begin(), by_top.end(),
+            [](const std::pair<double, OutlineRec*> & a, const std::pair<double, OutlineRec*> & b) { return a.first < b.first; });
+}
+
+void OutlineRecIndex::find_by_top(double min_top, double max_top, std::vector<OutlineRec*> & result) const
+{
+    auto iter = std::lower_bound(by_top.begin(), by_top.end(), min_top,
+            [](const std::pair<double, OutlineRec*> & a, double v) { return a.first < v; });
+    for (; iter != by_top.end() && iter->first <= max_top; ++iter)
+        result.push_back(iter->second);
+}
+
+void OutlineRecIndex::find_by_text(const std::vector<Unicode> & line_text, std::vector<OutlineRec*> & result) const
+{
+    for (size_t len : prefix_lens) {
+        if (line_text.size() < len)
+            continue;
+
+        auto range = by_prefix.equal_range(hash_prefix(line_text.data(), len));
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            const auto & text = iter->second->text;
+            if ((text.size() <= line_text.size()) && std::equal(text.begin(), text.end(), line_text.begin()))
+                result.push_back(iter->second);
+        }
+    }
+}
+
+uint64_t OutlineRecIndex::hash_prefix(const Unicode * u, size_t len)
+{
+    ContentHash hash;
+    hash.update(&len, sizeof(len));
+    hash.update(u, len * sizeof(Unicode));
+    return hash.get();
+}
@@ -8,7 +8,9 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <cstdint>
 #include <poppler/CharTypes.h>
 
 namespace pdf2htmlEX {
@@ -25,11 +27,40 @@ struct OutlineRec {
     bool                used;
 
     void add_text(const Unicode *u, int len);
+    // records without coordinates are matched by text
+    bool match_by_text() const { return left < 0.0001 && top < 0.0001 && text.size() > 0; }
 };
 
 typedef std::vector<OutlineRec>         OutlineRecVec;
 typedef std::map<int, OutlineRecVec>    OutlineRecMap;
 
+/*
+ * Outline records of a page, indexed for HTMLTextLine::dump_outline
+ * The records are referred by pointers, the vector should not be resized afterwards
+ */
+class OutlineRecIndex
+{
+public:
+    // zoom: the scale of top
+    void build(OutlineRecVec & items, double zoom);
+
+    // records matched by position, with zoom * top in [min_top, max_top]
+    void find_by_top(double min_top, double max_top, std::vector<OutlineRec*> & result) const;
+    // records matched by text, which is a prefix of line_text
+    void find_by_text(const std::vector<Unicode> & line_text, std::vector<OutlineRec*> & result) const;
+
+private:
+    // records are bucketed by the hash of their first (at most) PREFIX_LEN code points
+    static constexpr size_t PREFIX_LEN = 4;
+    static uint64_t hash_prefix(const Unicode * u, size_t len);
+
+    // zoom * top -> record, sorted
+    std::vector<std::pair<double, OutlineRec*>> by_top;
+    std::unordered_multimap<uint64_t, OutlineRec*> by_prefix;
+    // lengths of prefixes in by_prefix
+    std::vector<size_t> prefix_lens;
+};
+
 
 } //namespace pdf2htmlEX 
 #endif //OUTLINE_REC_H__
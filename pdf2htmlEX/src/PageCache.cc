@@ -0,0 +1,506 @@
+/*
+ * PageCache.cc
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+#include <climits>
+
+#include <Page.h>
+#include <Catalog.h>
+#include <XRef.h>
+
+#include "PageCache.h"
+#include "util/misc.h"
+
+namespace pdf2htmlEX {
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using std::ifstream;
+using std::ofstream;
+using std::cerr;
+using std::endl;
+
+static string to_hex(uint64_t v)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v);
+    return buf;
+}
+
+static uint64_t from_hex(const Json::Value & v)
+{
+    return strtoull(v.asString().c_str(), nullptr, 16);
+}
+
+PageCache::PageCache(const Param & param)
+    : param(param)
+    , doc(nullptr)
+    , reusable(false)
+    , options_hash(0)
+    , states(Json::objectValue)
+    , cycle_depth(INT_MAX)
+    , next_font_id(0)
+{ }
+
+void PageCache::load(PDFDoc * doc, const string & options)
+{
+    this->doc = doc;
+
+    ContentHash hash;
+    hash.update(options);
+    options_hash = hash.get();
+
+    ifstream in(param.page_cache, ifstream::binary);
+    if(!in)
+        return;
+
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    string errors;
+    if(!Json::parseFromStream(builder, in, &root, &errors) || !root.isObject())
+    {
+        cerr << "Warning: ignore invalid page cache " << param.page_cache << ": " << errors << endl;
+        return;
+    }
+
+    if(from_hex(root["options"]) != options_hash)
+    {
+        if(param.quiet == 0)
+            cerr << "Page cache was generated with different options, all pages will be converted" << endl;
+        return;
+    }
+
+    states = root["states"];
+
+    for(auto & e : root["fonts"])
+    {
+        long long id = e[1].asInt64();
+        cached_font_ids.insert(make_pair(from_hex(e[0]), make_pair(id, from_hex(e[2]))));
+        next_font_id = std::max(next_font_id, id + 1);
+    }
+
+    const Json::Value & pages = root["pages"];
+    for(auto iter = pages.begin(); iter != pages.end(); ++iter)
+    {
+        const Json::Value & v = *iter;
+        CachedPage page;
+        page.hash = from_hex(v["hash"]);
+        page.length = from_hex(v["length"]);
+        for(auto & f : v["fonts"])
+            page.fonts.push_back(make_pair(from_hex(f[0]), from_hex(f[1])));
+        page.frame_offset = v["frame"][0].asInt64();
+        page.frame_length = v["frame"][1].asInt64();
+        page.page_offset = v["page"][0].asInt64();
+        page.page_length = v["page"][1].asInt64();
+        for(auto & f : v["files"])
+        {
+            CachedFile file;
+            file.name = f[0].asString();
+            file.offset = f[1].asInt64();
+            file.length = f[2].asInt64();
+            page.files.push_back(file);
+        }
+        cached_pages.insert(make_pair(atoi(iter.name().c_str()), page));
+    }
+
+    reusable = true;
+}
+
+void PageCache::restore_states(AllStateManager & all_manager) const
+{
+    if(reusable)
+        restore_state_tables(all_manager, states);
+}
+
+void PageCache::hash_page(int pageno, ContentHash & hash)
+{
+    hash.update(&pageno, sizeof(pageno));
+
+    Page * page = doc->getPage(pageno);
+    if(!page)
+        return;
+
+    for(auto box : { page->getMediaBox(), page->getCropBox() })
+    {
+        double coords[4] = { box->x1, box->y1, box->x2, box->y2 };
+        hash.update(coords, sizeof(coords));
+    }
+    int rotate = page->getRotate();
+    hash.update(&rotate, sizeof(rotate));
+
+    hash_object(hash, page->getContents());
+    if(auto res = page->getResourceDictObject())
+        hash_object(hash, *res);
+    hash_object(hash, page->getAnnotsObject());
+}
+
+uint64_t PageCache::hash_font(const std::shared_ptr<GfxFont> & font)
+{
+    if(!font)
+        return 0;
+
+    long long fn_id = hash_ref(font->getID());
+    auto iter = font_keys.find(fn_id);
+    if(iter != font_keys.end())
+        return iter->second;
+
+    // a font keeps its id only if it is the same object
+    ContentHash hash;
+    hash.update(&fn_id, sizeof(fn_id));
+
+    hash_object(hash, doc->getXRef()->fetch(*font->getID()));
+
+    font_key_lengths[hash.get()] = hash.get_length();
+    return font_keys.insert(make_pair(fn_id, hash.get())).first->second;
+}
+
+void PageCache::hash_object(ContentHash & hash, const Object & obj)
+{
+    char type = (char)obj.getType();
+    hash.update(&type, sizeof(type));
+
+    switch(obj.getType())
+    {
+        case objBool:
+            {
+                bool v = obj.getBool();
+                hash.update(&v, sizeof(v));
+                break;
+            }
+        case objInt:
+            {
+                int v = obj.getInt();
+                hash.update(&v, sizeof(v));
+                break;
+            }
+        case objInt64:
+            {
+                long long v = obj.getInt64();
+                hash.update(&v, sizeof(v));
+                break;
+            }
+        case objReal:
+            {
+                double v = obj.getReal();
+                hash.update(&v, sizeof(v));
+                break;
+            }
+        case objString:
+        case objHexString:
+            {
+                auto s = obj.getString();
+                int len = s->getLength();
+                hash.update(&len, sizeof(len));
+                hash.update(s->c_str(), len);
+                break;
+            }
+        case objName:
+            hash.update(string(obj.getName()));
+            break;
+        case objArray:
+            {
+                int len = obj.arrayGetLength();
+                hash.update(&len, sizeof(len));
+                for(int i = 0; i < len; ++i)
+                    hash_object(hash, obj.arrayGetNF(i));
+                break;
+            }
+        case objDict:
+            hash_dict(hash, obj.getDict());
+            break;
+        case objStream:
+            hash_dict(hash, obj.streamGetDict());
+            hash_stream(hash, obj.getStream());
+            break;
+        case objRef:
+            hash_indirect(hash, obj);
+            break;
+        default:
+            break;
+    }
+}
+
+void PageCache::hash_indirect(ContentHash & hash, const Object & obj)
+{
+    Ref ref = obj.getRef();
+    long long id = hash_ref(&ref);
+
+    auto iter = object_digests.find(id);
+    if(iter != object_digests.end())
+    {
+        hash.update(&(iter->second.first), sizeof(iter->second.first));
+        hash.update(&(iter->second.second), sizeof(iter->second.second));
+        return;
+    }
+
+    int depth = (int)hashing.size();
+    auto p = hashing.insert(make_pair(id, depth));
+    if(!p.second)
+    {
+        // a cycle, only the distance matters
+        int distance = depth - p.first->second;
+        hash.update(&distance, sizeof(distance));
+        cycle_depth = std::min(cycle_depth, p.first->second);
+        return;
+    }
+
+    ContentHash digest;
+    int outer_cycle_depth = cycle_depth;
+    cycle_depth = INT_MAX;
+
+    Object target = obj.fetch(doc->getXRef());
+    if(target.isDict("Page"))
+    {
+        // links to other pages (e.g. /P of annotations), they may change independently
+        int pageno = doc->getCatalog()->findPage(ref);
+        digest.update(&pageno, sizeof(pageno));
+    }
+    else
+    {
+        hash_object(digest, target);
+    }
+
+    hashing.erase(id);
+    uint64_t value = digest.get(), length = digest.get_length();
+    hash.update(&value, sizeof(value));
+    hash.update(&length, sizeof(length));
+
+    // the digest depends on where a cycle was entered if it refers to an object still being hashed
+    if(cycle_depth >= depth)
+    {
+        object_digests.insert(make_pair(id, make_pair(value, length)));
+        cycle_depth = outer_cycle_depth;
+    }
+    else
+    {
+        cycle_depth = std::min(cycle_depth, outer_cycle_depth);
+    }
+}
+
+void PageCache::hash_dict(ContentHash & hash, Dict * dict)
+{
+    int len = dict->getLength();
+    hash.update(&len, sizeof(len));
+    for(int i = 0; i < len; ++i)
+    {
+        // page dictionaries are never hashed here, references to them are replaced by page numbers
+        const char * key = dict->getKey(i);
+        hash.update(string(key));
+        hash_object(hash, dict->getValNF(i));
+    }
+}
+
+void PageCache::hash_stream(ContentHash & hash, Stream * str)
+{
+    // the raw data is enough, and cheaper than decoding
+    Stream * raw = str->getUndecodedStream();
+    raw->reset();
+    unsigned char buf[4096];
+    int len;
+    while((len = raw->doGetChars(sizeof(buf), buf)) > 0)
+        hash.update(buf, len);
+    raw->close();
+}
+
+long long PageCache::get_font_id(uint64_t font_key)
+{
+    long long id;
+    auto iter = cached_font_ids.find(font_key);
+    if((iter != cached_font_ids.end())
+            && (iter->second.second == font_key_lengths[font_key])
+            && (used_font_ids.count(iter->second.first) == 0))
+        id = iter->second.first;
+    else
+        id = next_font_id++;
+
+    used_font_ids.insert(id);
+    font_ids[font_key] = id;
+    return id;
+}
+
+const PageCache::CachedPage * PageCache::find_page(int pageno, const ContentHash & hash) const
+{
+    if(!reusable)
+        return nullptr;
+
+    auto iter = cached_pages.find(pageno);
+    if((iter == cached_pages.end())
+            || (iter->second.hash != hash.get())
+            || (iter->second.length != hash.get_length()))
+        return nullptr;
+
+    return &(iter->second);
+}
+
+void PageCache::read_page(const CachedPage & page, string & frame, string & page_html) const
+{
+    ifstream in(param.page_cache + ".data", ifstream::binary);
+    if(!in)
+        throw string("Cannot open ") + param.page_cache + ".data for reading";
+
+    frame.resize(page.frame_length);
+    in.seekg(page.frame_offset);
+    in.read(&frame[0], page.frame_length);
+
+    page_html.resize(page.page_length);
+    in.seekg(page.page_offset);
+    in.read(&page_html[0], page.page_length);
+
+    if(!in)
+        throw string("Cannot read ") + param.page_cache + ".data";
+}
+
+void PageCache::read_file(const CachedFile & file, string & content) const
+{
+    ifstream in(param.page_cache + ".data", ifstream::binary);
+    content.resize(file.length);
+    in.seekg(file.offset);
+    in.read(&content[0], file.length);
+    if(!in)
+        throw string("Cannot read ") + param.page_cache + ".data";
+}
+
+void PageCache::add_page(int pageno, const ContentHash & hash, const vector<pair<uint64_t, uint64_t>> & fonts,
+        long long frame_begin, long long frame_end, const string & page_path,
+        const vector<string> & files)
+{
+    PageRecord & r = new_pages[pageno];
+    r.hash = hash.get();
+    r.length = hash.get_length();
+    r.fonts = fonts;
+    r.frame_begin = frame_begin;
+    r.frame_end = frame_end;
+    r.page_path = page_path;
+    r.files = files;
+}
+
+void PageCache::save(const AllStateManager & all_manager, const string & pages_path)
+{
+    /*
+     * {
+     *   "options": hash,
+     *   "states": { "<manager>": [ [value..., id] ] },
+     *   "fonts": [ [key, id, length of key] ],
+     *   "pages": { "<page number>": { "hash": hash, "length": length, "fonts": [ [key, hash of used codes] ],
+     *                                 "frame": [offset, length], "page": [offset, length],
+     *                                 "files": [ [name, offset, length] ] } }
+     * }
+     */
+    Json::Value root(Json::objectValue);
+    root["options"] = to_hex(options_hash);
+
+    save_state_tables(all_manager, root["states"]);
+
+    Json::Value & fonts = root["fonts"];
+    fonts = Json::Value(Json::arrayValue);
+    for(auto & p : font_ids)
+    {
+        Json::Value e(Json::arrayValue);
+        e.append(to_hex(p.first));
+        e.append((Json::Int64)p.second);
+        e.append(to_hex(font_key_lengths[p.first]));
+        fonts.append(e);
+    }
+
+    // the data file is read by read_page, all pages have been processed at this point
+    string data_path = param.page_cache + ".data";
+    ofstream data(data_path, ofstream::binary);
+    ifstream pages_in(pages_path, ifstream::binary);
+    if(!data || !pages_in)
+    {
+        cerr << "Warning: cannot write page cache " << data_path << endl;
+        // the old index does not match the data any more
+        remove(param.page_cache.c_str());
+        return;
+    }
+
+    Json::Value & pages = root["pages"];
+    pages = Json::Value(Json::objectValue);
+    string buf;
+    // files shared by pages are stored once: name -> [offset, length]
+    std::map<string, Json::Value> saved_files;
+    for(auto & p : new_pages)
+    {
+        const PageRecord & r = p.second;
+        Json::Value v(Json::objectValue);
+        v["hash"] = to_hex(r.hash);
+        v["length"] = to_hex(r.length);
+        v["fonts"] = Json::Value(Json::arrayValue);
+        for(auto & f : r.fonts)
+        {
+            Json::Value e(Json::arrayValue);
+            e.append(to_hex(f.first));
+            e.append(to_hex(f.second));
+            v["fonts"].append(e);
+        }
+
+        buf.resize(r.frame_end - r.frame_begin);
+        pages_in.seekg(r.frame_begin);
+        pages_in.read(&buf[0], buf.size());
+        v["frame"].append((Json::Int64)data.tellp());
+        v["frame"].append((Json::Int64)buf.size());
+        data.write(buf.data(), buf.size());
+
+        buf.clear();
+        if(!r.page_path.empty())
+        {
+            ifstream page_in(r.page_path, ifstream::binary);
+            buf.assign(std::istreambuf_iterator<char>(page_in), std::istreambuf_iterator<char>());
+        }
+        v["page"].append((Json::Int64)data.tellp());
+        v["page"].append((Json::Int64)buf.size());
+        data.write(buf.data(), buf.size());
+
+        v["files"] = Json::Value(Json::arrayValue);
+        for(auto & name : r.files)
+        {
+            auto iter = saved_files.find(name);
+            if(iter == saved_files.end())
+            {
+                ifstream file_in(param.dest_dir + "/" + name, ifstream::binary);
+                if(!file_in)
+                {
+                    cerr << "Warning: cannot read " << name << ", page " << p.first << " is not cached" << endl;
+                    break;
+                }
+                buf.assign(std::istreambuf_iterator<char>(file_in), std::istreambuf_iterator<char>());
+                Json::Value e(Json::arrayValue);
+                e.append(name);
+                e.append((Json::Int64)data.tellp());
+                e.append((Json::Int64)buf.size());
+                data.write(buf.data(), buf.size());
+                iter = saved_files.insert(make_pair(name, e)).first;
+            }
+            v["files"].append(iter->second);
+        }
+        if(v["files"].size() != r.files.size())
+            continue;
+
+        pages[std::to_string(p.first)] = v;
+    }
+
+    if(!pages_in || !data)
+    {
+        cerr << "Warning: cannot write page cache " << data_path << endl;
+        remove(param.page_cache.c_str());
+        return;
+    }
+
+    ofstream out(param.page_cache, ofstream::binary);
+    if(!out)
+    {
+        cerr << "Warning: cannot open " << param.page_cache << " for writing" << endl;
+        return;
+    }
+    out << root.toStyledString();
+}
+
+} // namespace pdf2htmlEX
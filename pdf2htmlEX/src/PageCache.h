@@ -0,0 +1,156 @@
+/*
+ * PageCache.h
+ *
+ * Reuse the HTML of unchanged pages from a previous conversion, see --page-cache
+ */
+
+#ifndef PAGECACHE_H__
+#define PAGECACHE_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+
+#include <PDFDoc.h>
+#include <GfxFont.h>
+#include <jsoncpp/json/json.h>
+
+#include "Param.h"
+#include "StateManager.h"
+#include "util/hash.h"
+
+namespace pdf2htmlEX {
+
+/*
+ * A page is reused if its content, resources, annotations and outline items hash to the
+ * same value, of the same length, as in the previous conversion, and the fonts it uses have
+ * the same used codes, such that their reencoding is unchanged.
+ *
+ * Files in the destination directory used by a page (e.g. background images) are stored
+ * with the page, and written back when the page is reused.
+ *
+ * To keep the cached HTML valid:
+ *  - the CSS classes of the previous conversion are restored before any page is processed
+ *  - a font keeps its id as long as its dictionary (and font program) is unchanged
+ *
+ * Restored CSS classes are never pruned: classes used only by pages that have since changed
+ * or been removed stay in the output, and in the cache, until the cache file is deleted.
+ *
+ * Each indirect object is hashed once per document, pages (and fonts) fold in the digests
+ * of the objects they refer to, such that shared resources are not hashed again for every page.
+ *
+ * The cache is dropped if the options or the version of pdf2htmlEX are different.
+ *
+ * The index is stored in JSON, the HTML and files of pages are stored in "<cache file>.data".
+ */
+class PageCache
+{
+public:
+    explicit PageCache(const Param & param);
+
+    bool enabled(void) const { return !param.page_cache.empty(); }
+
+    /*
+     * Read the cache file
+     * options: everything other than the document that affects the output
+     */
+    void load(PDFDoc * doc, const std::string & options);
+    // should be called before any state is installed
+    void restore_states(AllStateManager & all_manager) const;
+
+    // hash the page dictionary and everything it refers to
+    void hash_page(int pageno, ContentHash & hash);
+    // hash of the font dictionary, 0 for the default font
+    uint64_t hash_font(const std::shared_ptr<GfxFont> & font);
+
+    // the id of the font in the previous conversion if possible
+    long long get_font_id(uint64_t font_key);
+
+    struct CachedFile
+    {
+        // relative to the destination directory
+        std::string name;
+        // in the data file
+        long long offset, length;
+    };
+
+    struct CachedPage
+    {
+        uint64_t hash, length;
+        // font key -> hash of used codes
+        std::vector<std::pair<uint64_t, uint64_t>> fonts;
+        // in the data file: what was written into f_pages, and the page file for --split-pages
+        long long frame_offset, frame_length;
+        long long page_offset, page_length;
+        std::vector<CachedFile> files;
+    };
+
+    // nullptr if not found
+    const CachedPage * find_page(int pageno, const ContentHash & hash) const;
+    void read_page(const CachedPage & page, std::string & frame, std::string & page_html) const;
+    void read_file(const CachedFile & file, std::string & content) const;
+
+    /*
+     * Record a finished page
+     * The page is read from [frame_begin, frame_end) of pages_path, and page_path if not empty, when saving.
+     * files: used by the page, relative to the destination directory, read when saving
+     */
+    void add_page(int pageno, const ContentHash & hash, const std::vector<std::pair<uint64_t, uint64_t>> & fonts,
+            long long frame_begin, long long frame_end, const std::string & page_path,
+            const std::vector<std::string> & files);
+
+    // write the cache file and the data file, pages_path should have been closed
+    void save(const AllStateManager & all_manager, const std::string & pages_path);
+
+private:
+    void hash_object(ContentHash & hash, const Object & obj);
+    void hash_indirect(ContentHash & hash, const Object & obj);
+    void hash_dict(ContentHash & hash, Dict * dict);
+    void hash_stream(ContentHash & hash, Stream * str);
+
+    const Param & param;
+    PDFDoc * doc;
+    // false if there is no valid cache file
+    bool reusable;
+    uint64_t options_hash;
+
+    // the objects in the cache file
+    Json::Value states;
+    std::map<int, CachedPage> cached_pages;
+    // font key -> id, length of the font key
+    std::unordered_map<uint64_t, std::pair<long long, uint64_t>> cached_font_ids;
+
+    // hash_ref of indirect objects -> digest and length of the hashed data
+    std::unordered_map<long long, std::pair<uint64_t, uint64_t>> object_digests;
+    // hash_ref of the objects being hashed -> depth
+    std::unordered_map<long long, int> hashing;
+    // smallest depth of the objects being hashed that have been referred to again (cycles)
+    int cycle_depth;
+    // hash_ref of font IDs -> font key
+    std::unordered_map<long long, uint64_t> font_keys;
+    // font key -> length of the hashed data
+    std::unordered_map<uint64_t, uint64_t> font_key_lengths;
+
+    // font key -> id, in this conversion
+    std::map<uint64_t, long long> font_ids;
+    std::set<long long> used_font_ids;
+    long long next_font_id;
+
+    struct PageRecord
+    {
+        uint64_t hash, length;
+        std::vector<std::pair<uint64_t, uint64_t>> fonts;
+        long long frame_begin, frame_end;
+        std::string page_path;
+        std::vector<std::string> files;
+    };
+    std::map<int, PageRecord> new_pages;
+};
+
+} // namespace pdf2htmlEX
+
+#endif //PAGECACHE_H__
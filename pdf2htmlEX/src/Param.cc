@@ -28,6 +28,7 @@ void Param::dump(std::ostream &s) const
     S(s, actual_dpi);
     S(s, max_dpi);
     S(s, text_dpi);
+    S(s, bg_pixel_budget);
 
     s << endl << "output" << endl;
     S(s, embed_css);
@@ -48,6 +49,8 @@ void Param::dump(std::ostream &s) const
     S(s, printing);
     S(s, fallback);
     S(s, tmp_file_size_limit);
+    S(s, page_cache);
+    S(s, serve);
 
     s << endl << "fonts" << endl;
     S(s, embed_external_font);
@@ -60,6 +63,7 @@ void Param::dump(std::ostream &s) const
     S(s, squeeze_wide_glyph);
     S(s, override_fstype);
     S(s, process_type3);
+    S(s, merge_duplicate_fonts);
 
     s << endl << "text" << endl;
     S(s, h_eps)
@@ -72,6 +76,12 @@ void Param::dump(std::ostream &s) const
 
     s << endl << "background image" << endl;
     S(s, bg_format);
+    S(s, bg_tile_size);
+    S(s, bg_png_mode);
+    S(s, bg_png_compression_level);
+    S(s, bg_jpeg_passthrough);
+    S(s, bg_srcset_levels);
+    S(s, bg_preview_dpi);
     S(s, svg_node_count_limit);
     S(s, svg_embed_bitmap);
 
@@ -85,10 +95,15 @@ void Param::dump(std::ostream &s) const
     S(s, data_dir);
     S(s, poppler_data_dir);
     S(s, tmp_dir);
+    S(s, checkpoint_dir);
+    S(s, checkpoint_interval);
+    S(s, resume);
     S(s, debug);
     S(s, proof);
     S(s, quiet);
     S(s, memstat); // add cpu and mem stat to console output
+    S(s, stats_json);
+    S(s, trace_file);
     S(s, disable_ref); // disable reference table in output file
     S(s, tags); // process tags
 
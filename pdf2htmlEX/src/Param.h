@@ -27,6 +27,7 @@ struct Param
     double actual_dpi;
     double max_dpi;
     double text_dpi;
+    double bg_pixel_budget;
 
     // output
     int embed_css;
@@ -47,6 +48,8 @@ struct Param
     int printing;
     int fallback;
     int tmp_file_size_limit;
+    std::string page_cache;
+    std::string serve;
 
     // fonts
     int embed_external_font;
@@ -59,6 +62,7 @@ struct Param
     int squeeze_wide_glyph;
     int override_fstype;
     int process_type3;
+    int merge_duplicate_fonts;
 
     // text
     double h_eps, v_eps;
@@ -70,6 +74,12 @@ struct Param
 
     // background image
     std::string bg_format;
+    int bg_tile_size;
+    std::string bg_png_mode;
+    int bg_png_compression_level;
+    int bg_jpeg_passthrough;
+    int bg_srcset_levels;
+    double bg_preview_dpi;
     int svg_node_count_limit;
     int svg_embed_bitmap;
 
@@ -82,10 +92,15 @@ struct Param
     std::string data_dir;
     std::string poppler_data_dir;
     std::string tmp_dir;
+    std::string checkpoint_dir;
+    int checkpoint_interval;
+    int resume;
     int debug;
     int proof;
     int quiet;
     int memstat; // add cpu and mem stat to console output
+    std::string stats_json;
+    std::string trace_file;
     int disable_ref; // disable reference table in output file
     int tags; // process tags
 
@@ -84,6 +84,7 @@ void Preprocessor::drawChar(GfxState *state, double x, double y,
             int len = font->isCIDFont() ? 0x10000 : 0x100;
             p.first->second = new char [len];
             memset(p.first->second, 0, len * sizeof(char));
+            fonts.insert(std::make_pair(cur_font_id, font));
         }
 
         cur_code_map = p.first->second;
@@ -109,4 +110,18 @@ const char * Preprocessor::get_code_map (long long font_id) const
     return (iter == code_maps.end()) ? nullptr : (iter->second);
 }
 
+void Preprocessor::merge_code_map (long long dest_font_id, long long src_font_id)
+{
+    auto dest_iter = code_maps.find(dest_font_id);
+    auto src_iter = code_maps.find(src_font_id);
+    if((dest_iter == code_maps.end()) || (src_iter == code_maps.end()))
+        return;
+
+    // fonts to be merged are of the same kind, so are their code maps
+    auto font_iter = fonts.find(dest_font_id);
+    int len = (font_iter != fonts.end() && font_iter->second->isCIDFont()) ? 0x10000 : 0x100;
+    for(int i = 0; i < len; ++i)
+        dest_iter->second[i] |= src_iter->second[i];
+}
+
 } // namespace pdf2htmlEX
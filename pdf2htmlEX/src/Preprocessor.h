@@ -15,6 +15,8 @@
 #define PREPROCESSOR_H__
 
 #include <unordered_map>
+#include <map>
+#include <memory>
 
 #include <OutputDev.h>
 #include <PDFDoc.h>
@@ -47,6 +49,10 @@ public:
     virtual void startPage(int pageNum, GfxState *state, XRef * xref);
 
     const char * get_code_map (long long font_id) const;
+    // mark codes used by src_font_id as used by dest_font_id as well
+    void merge_code_map (long long dest_font_id, long long src_font_id);
+    // all fonts used in the document, indexed by hash_ref of their IDs
+    const std::map<long long, std::shared_ptr<GfxFont>> & get_fonts (void) const { return fonts; }
     double get_max_width (void) const { return max_width; }
     double get_max_height (void) const { return max_height; }
 
@@ -59,6 +65,7 @@ protected:
     char * cur_code_map;
 
     std::unordered_map<long long, char*> code_maps;
+    std::map<long long, std::shared_ptr<GfxFont>> fonts;
 };
 
 } // namespace pdf2htmlEX
@@ -0,0 +1,124 @@
+/*
+ * StateManager.cc
+ */
+
+#include <jsoncpp/json/json.h>
+
+#include "StateManager.h"
+
+namespace pdf2htmlEX {
+
+// [value, id]
+template<class Manager>
+static Json::Value save_double_states(const Manager & manager)
+{
+    Json::Value r(Json::arrayValue);
+    for(auto & p : manager.get_value_map())
+    {
+        Json::Value e(Json::arrayValue);
+        e.append(p.first);
+        e.append((Json::Int64)p.second);
+        r.append(e);
+    }
+    return r;
+}
+
+template<class Manager>
+static void restore_double_states(Manager & manager, const Json::Value & v)
+{
+    for(auto & e : v)
+        manager.restore(e[0].asDouble(), e[1].asInt64());
+}
+
+// [m0, m1, m2, m3, id]
+static Json::Value save_matrix_states(const TransformMatrixManager & manager)
+{
+    Json::Value r(Json::arrayValue);
+    for(auto & p : manager.get_value_map())
+    {
+        Json::Value e(Json::arrayValue);
+        for(int i = 0; i < 4; ++i)
+            e.append(p.first.m[i]);
+        e.append((Json::Int64)p.second);
+        r.append(e);
+    }
+    return r;
+}
+
+static void restore_matrix_states(TransformMatrixManager & manager, const Json::Value & v)
+{
+    for(auto & e : v)
+    {
+        double m[4];
+        for(int i = 0; i < 4; ++i)
+            m[i] = e[i].asDouble();
+        manager.restore(m, e[4].asInt64());
+    }
+}
+
+// [transparent, r, g, b, id]
+template<class Manager>
+static Json::Value save_color_states(const Manager & manager)
+{
+    Json::Value r(Json::arrayValue);
+    for(auto & p : manager.get_value_map())
+    {
+        Json::Value e(Json::arrayValue);
+        e.append(p.first.transparent);
+        e.append((Json::Int64)p.first.rgb.r);
+        e.append((Json::Int64)p.first.rgb.g);
+        e.append((Json::Int64)p.first.rgb.b);
+        e.append((Json::Int64)p.second);
+        r.append(e);
+    }
+    return r;
+}
+
+template<class Manager>
+static void restore_color_states(Manager & manager, const Json::Value & v)
+{
+    for(auto & e : v)
+    {
+        Color color;
+        color.transparent = e[0].asBool();
+        color.rgb.r = (GfxColorComp)e[1].asInt64();
+        color.rgb.g = (GfxColorComp)e[2].asInt64();
+        color.rgb.b = (GfxColorComp)e[3].asInt64();
+        manager.restore(color, e[4].asInt64());
+    }
+}
+
+void save_state_tables(const AllStateManager & all_manager, Json::Value & out)
+{
+    out = Json::Value(Json::objectValue);
+    out["transform_matrix"] = save_matrix_states(all_manager.transform_matrix);
+    out["vertical_align"]   = save_double_states(all_manager.vertical_align);
+    out["stroke_color"]     = save_color_states (all_manager.stroke_color);
+    out["letter_space"]     = save_double_states(all_manager.letter_space);
+    out["whitespace"]       = save_double_states(all_manager.whitespace);
+    out["word_space"]       = save_double_states(all_manager.word_space);
+    out["fill_color"]       = save_color_states (all_manager.fill_color);
+    out["font_size"]        = save_double_states(all_manager.font_size);
+    out["bottom"]           = save_double_states(all_manager.bottom);
+    out["height"]           = save_double_states(all_manager.height);
+    out["width"]            = save_double_states(all_manager.width);
+    out["left"]             = save_double_states(all_manager.left);
+}
+
+void restore_state_tables(AllStateManager & all_manager, const Json::Value & in)
+{
+    restore_matrix_states(all_manager.transform_matrix, in["transform_matrix"]);
+    restore_double_states(all_manager.vertical_align, in["vertical_align"]);
+    restore_color_states (all_manager.stroke_color,   in["stroke_color"]);
+    restore_double_states(all_manager.letter_space,   in["letter_space"]);
+    restore_double_states(all_manager.whitespace,     in["whitespace"]);
+    restore_double_states(all_manager.word_space,     in["word_space"]);
+    restore_color_states (all_manager.fill_color,     in["fill_color"]);
+    restore_double_states(all_manager.font_size,      in["font_size"]);
+    restore_double_states(all_manager.bottom,         in["bottom"]);
+    restore_double_states(all_manager.height,         in["height"]);
+    restore_double_states(all_manager.width,          in["width"]);
+    restore_double_states(all_manager.left,           in["left"]);
+}
+
+} // namespace pdf2htmlEX
@@ -12,12 +12,15 @@
 #include <iostream>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 #include "Color.h"
 
 #include "util/math.h"
 #include "util/css_const.h"
 
+namespace Json { class Value; }
+
 namespace pdf2htmlEX {
 
 template<class ValueType, class Imp> class StateManager {};
@@ -69,23 +72,35 @@ public:
         return id;
     }
 
-    void dump_css(std::ostream & out) {
+    // classes with id < first are skipped
+    void dump_css(std::ostream & out, size_t first = 0) {
         for(auto & p : value_map)
         {
+            if((size_t)p.second < first)
+                continue;
             out << "." << imp->get_css_class_name() << p.second << "{";
             imp->dump_value(out, p.first);
             out << "}" << std::endl;
         }
     }
 
-    void dump_print_css(std::ostream & out, double scale) {
+    void dump_print_css(std::ostream & out, double scale, size_t first = 0) {
         for(auto & p : value_map)
         {
+            if((size_t)p.second < first)
+                continue;
             out << "." << imp->get_css_class_name() << p.second << "{";
             imp->dump_print_value(out, p.first, scale);
             out << "}" << std::endl;
         }
     }
+    // number of css classes
+    size_t size(void) const { return value_map.size(); }
+
+    // for save_state_tables
+    const std::map<double, long long> & get_value_map(void) const { return value_map; }
+    // install a value with a known id, ids must be restored before any install()
+    void restore(double value, long long id) { value_map.insert(std::make_pair(value, id)); }
 
 protected:
     double eps;
@@ -119,16 +134,30 @@ public:
         return id;
     }
 
-    void dump_css(std::ostream & out) {
+    // classes with id < first are skipped
+    void dump_css(std::ostream & out, size_t first = 0) {
         for(auto & p : value_map)
         {
+            if((size_t)p.second < first)
+                continue;
             out << "." << imp->get_css_class_name() << p.second << "{";
             imp->dump_value(out, p.first);
             out << "}" << std::endl;
         }
     }
 
-    void dump_print_css(std::ostream & out, double scale) {}
+    void dump_print_css(std::ostream & out, double scale, size_t first = 0) {}
+
+    // number of css classes
+    size_t size(void) const { return value_map.size(); }
+
+    // for save_state_tables
+    const auto & get_value_map(void) const { return value_map; }
+    void restore(const double * value, long long id) {
+        Matrix m;
+        memcpy(m.m, value, 4 * sizeof(double));
+        value_map.insert(std::make_pair(m, id));
+    }
 
 protected:
     Imp * imp;
@@ -172,20 +201,33 @@ public:
         return id;
     }
 
-    void dump_css(std::ostream & out) {
-        out << "." << imp->get_css_class_name() << CSS::INVALID_ID << "{";
-        imp->dump_transparent(out);
-        out << "}" << std::endl;
+    // classes with id < first are skipped
+    void dump_css(std::ostream & out, size_t first = 0) {
+        if(first == 0)
+        {
+            out << "." << imp->get_css_class_name() << CSS::INVALID_ID << "{";
+            imp->dump_transparent(out);
+            out << "}" << std::endl;
+        }
 
         for(auto & p : value_map)
         {
+            if((size_t)p.second < first)
+                continue;
             out << "." << imp->get_css_class_name() << p.second << "{";
             imp->dump_value(out, p.first);
             out << "}" << std::endl;
         }
     }
 
-    void dump_print_css(std::ostream & out, double scale) {}
+    void dump_print_css(std::ostream & out, double scale, size_t first = 0) {}
+
+    // number of css classes
+    size_t size(void) const { return value_map.size(); }
+
+    // for save_state_tables
+    const auto & get_value_map(void) const { return value_map; }
+    void restore(const Color & value, long long id) { value_map.insert(std::make_pair(value, id)); }
 
 protected:
     Imp * imp;
@@ -342,9 +384,11 @@ class FillColorManager : public StateManager<Color, FillColorManager>
 public:
     static const char * get_css_class_name (void) { return CSS::FILL_COLOR_CN; }
     /* override base's method, as we need some workaround in CSS */ 
-    void dump_css(std::ostream & out) { 
+    void dump_css(std::ostream & out, size_t first = 0) { 
         for(auto & p : value_map)
         {
+            if((size_t)p.second < first)
+                continue;
             out << "." << get_css_class_name() << p.second 
                 << "{color:" << p.first << ";}" << std::endl;
         }
@@ -356,11 +400,14 @@ class StrokeColorManager : public StateManager<Color, StrokeColorManager>
 public:
     static const char * get_css_class_name (void) { return CSS::STROKE_COLOR_CN; }
     /* override base's method, as we need some workaround in CSS */ 
-    void dump_css(std::ostream & out) { 
+    void dump_css(std::ostream & out, size_t first = 0) { 
         // normal CSS
-        out << "." << get_css_class_name() << CSS::INVALID_ID << "{text-shadow:none;}" << std::endl;
+        if(first == 0)
+            out << "." << get_css_class_name() << CSS::INVALID_ID << "{text-shadow:none;}" << std::endl;
         for(auto & p : value_map)
         {
+            if((size_t)p.second < first)
+                continue;
             // TODO: take the stroke width from the graphics state,
             //       currently using 0.015em as a good default
             out << "." << get_css_class_name() << p.second << "{text-shadow:" 
@@ -372,9 +419,12 @@ public:
         }
         // webkit
         out << CSS::WEBKIT_ONLY << "{" << std::endl;
-        out << "." << get_css_class_name() << CSS::INVALID_ID << "{-webkit-text-stroke:0px transparent;}" << std::endl;
+        if(first == 0)
+            out << "." << get_css_class_name() << CSS::INVALID_ID << "{-webkit-text-stroke:0px transparent;}" << std::endl;
         for(auto & p : value_map)
         {
+            if((size_t)p.second < first)
+                continue;
             out << "." << get_css_class_name() << p.second 
                 << "{-webkit-text-stroke:0.015em " << p.first << ";text-shadow:none;}" << std::endl;
         }
@@ -392,31 +442,55 @@ class BGImageSizeManager
 {
 public:
     void install(int page_no, double width, double height){
-        value_map.insert(std::make_pair(page_no, std::make_pair(width, height)));
+        if(value_map.insert(std::make_pair(page_no, std::make_pair(width, height))).second)
+            pages.push_back(page_no);
     }
 
-    void dump_css(std::ostream & out) {
-        for(auto & p : value_map)
+    // the first pages installed are skipped
+    void dump_css(std::ostream & out, size_t first = 0) {
+        for(size_t i = first; i < pages.size(); ++i)
         {
-            const auto & s = p.second;
-            out << "." << CSS::PAGE_CONTENT_BOX_CN << p.first << "{";
+            const auto & s = value_map[pages[i]];
+            out << "." << CSS::PAGE_CONTENT_BOX_CN << pages[i] << "{";
             out << "background-size:" << round(s.first) << "px " << round(s.second) << "px;";
             out << "}" << std::endl;
         }
     }
 
-    void dump_print_css(std::ostream & out, double scale) {
-        for(auto & p : value_map)
+    void dump_print_css(std::ostream & out, double scale, size_t first = 0) {
+        for(size_t i = first; i < pages.size(); ++i)
         {
-            const auto & s = p.second;
-            out << "." << CSS::PAGE_CONTENT_BOX_CN << p.first << "{";
+            const auto & s = value_map[pages[i]];
+            out << "." << CSS::PAGE_CONTENT_BOX_CN << pages[i] << "{";
             out << "background-size:" << round(s.first * scale) << "pt " << round(s.second * scale) << "pt;";
             out << "}" << std::endl;
         }
     }
 
+    size_t size(void) const { return value_map.size(); }
+
 private:
     std::unordered_map<int, std::pair<double,double>> value_map; 
+    // in the order of installation
+    std::vector<int> pages;
+};
+
+// number of classes in each table of AllStateManager
+struct AllStateSizes
+{
+    size_t transform_matrix = 0;
+    size_t vertical_align = 0;
+    size_t stroke_color = 0;
+    size_t letter_space = 0;
+    size_t whitespace = 0;
+    size_t word_space = 0;
+    size_t fill_color = 0;
+    size_t font_size = 0;
+    size_t bottom = 0;
+    size_t height = 0;
+    size_t width = 0;
+    size_t left = 0;
+    size_t bgimage_size = 0;
 };
 
 struct AllStateManager
@@ -434,8 +508,33 @@ struct AllStateManager
     WidthManager                      width;
     LeftManager                        left;
     BGImageSizeManager         bgimage_size;
+
+    AllStateSizes get_sizes(void) const {
+        AllStateSizes s;
+        s.transform_matrix = transform_matrix.size();
+        s.vertical_align   = vertical_align  .size();
+        s.stroke_color     = stroke_color    .size();
+        s.letter_space     = letter_space    .size();
+        s.whitespace       = whitespace      .size();
+        s.word_space       = word_space      .size();
+        s.fill_color       = fill_color      .size();
+        s.font_size        = font_size       .size();
+        s.bottom           = bottom          .size();
+        s.height           = height          .size();
+        s.width            = width           .size();
+        s.left             = left            .size();
+        s.bgimage_size     = bgimage_size    .size();
+        return s;
+    }
 };
 
+/*
+ * All tables in JSON, except bgimage_size, for PageCache and Checkpoint
+ * Tables should be restored before any value is installed.
+ */
+void save_state_tables(const AllStateManager & all_manager, Json::Value & out);
+void restore_state_tables(AllStateManager & all_manager, const Json::Value & in);
+
 } // namespace pdf2htmlEX 
 
 #endif //STATEMANAGER_H__
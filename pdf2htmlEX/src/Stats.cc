@@ -0,0 +1,244 @@
+/*
+ * Stats.cc
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sys/stat.h>
+
+#include <jsoncpp/json/json.h>
+
+#include "Stats.h"
+
+#ifdef __MINGW32__
+#include "util/mingw.h"
+#endif
+
+using namespace std;
+
+namespace pdf2htmlEX {
+
+Stats::Stats(const Param & param)
+    : param(param)
+    , start_time(chrono::steady_clock::now())
+{
+    thread_ids.insert(make_pair(this_thread::get_id(), 1));
+}
+
+Stats::Timer::Timer(Stats & stats, const char * phase, long long key, bool trace_only)
+    : stats(stats)
+    , phase(phase)
+    , key(key)
+    , trace_only(trace_only)
+{
+    start();
+}
+
+Stats::Timer::~Timer()
+{
+    finish();
+}
+
+void Stats::Timer::next(const char * phase)
+{
+    finish();
+    this->phase = phase;
+    start();
+}
+
+void Stats::Timer::start(void)
+{
+    if(!stats.enabled())
+        return;
+
+    wall_start = chrono::steady_clock::now();
+    cpu_start = clock();
+}
+
+void Stats::Timer::finish(void)
+{
+    if(!stats.enabled())
+        return;
+
+    auto wall_end = chrono::steady_clock::now();
+    // CPU time of all threads
+    double cpu = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    std::lock_guard<std::mutex> lock(stats.mutex);
+
+    if((!trace_only) && (!stats.param.stats_json.empty()))
+    {
+        auto & timing = stats.timings[phase][key];
+        timing.wall += chrono::duration<double>(wall_end - wall_start).count();
+        timing.cpu += cpu;
+        ++timing.calls;
+    }
+
+    if(!stats.param.trace_file.empty())
+    {
+        auto tid = this_thread::get_id();
+        auto iter = stats.thread_ids.find(tid);
+        if(iter == stats.thread_ids.end())
+            iter = stats.thread_ids.insert(make_pair(tid, (int)stats.thread_ids.size() + 1)).first;
+
+        TraceEvent event;
+        event.name = phase;
+        event.key = key;
+        event.ts = chrono::duration<double, micro>(wall_start - stats.start_time).count();
+        event.dur = chrono::duration<double, micro>(wall_end - wall_start).count();
+        event.tid = iter->second;
+        stats.trace_events.push_back(event);
+    }
+}
+
+void Stats::add_count(const string & name, long long value)
+{
+    if(param.stats_json.empty())
+        return;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    counters[name] += value;
+}
+
+void Stats::set_count(const string & name, long long value)
+{
+    if(param.stats_json.empty())
+        return;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    counters[name] = value;
+}
+
+void Stats::add_output_file(const string & fn)
+{
+    if(param.stats_json.empty())
+        return;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    output_files.insert(fn);
+}
+
+void Stats::dump()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if(!param.stats_json.empty())
+        dump_stats();
+    if(!param.trace_file.empty())
+        dump_trace();
+}
+
+static Json::Value timing_to_json(double wall, double cpu, long long calls)
+{
+    Json::Value v(Json::objectValue);
+    v["wall"] = wall;
+    v["cpu"] = cpu;
+    v["calls"] = (Json::Int64)calls;
+    return v;
+}
+
+void Stats::dump_stats() const
+{
+    /*
+     * {
+     *   "phases": { "<phase>": { "wall": s, "cpu": s, "calls": n, "items": { "<key>": {...} } } },
+     *   "counters": { "<name>": n },
+     *   "files": { "<path>": bytes }
+     * }
+     */
+    Json::Value result(Json::objectValue);
+
+    Json::Value phases(Json::objectValue);
+    for(auto & p : timings)
+    {
+        double wall = 0, cpu = 0;
+        long long calls = 0;
+        Json::Value items(Json::objectValue);
+        for(auto & t : p.second)
+        {
+            wall += t.second.wall;
+            cpu += t.second.cpu;
+            calls += t.second.calls;
+            if(t.first >= 0)
+                items[to_string(t.first)] = timing_to_json(t.second.wall, t.second.cpu, t.second.calls);
+        }
+        auto phase = timing_to_json(wall, cpu, calls);
+        if(!items.empty())
+            phase["items"] = items;
+        phases[p.first] = phase;
+    }
+    result["phases"] = phases;
+
+    Json::Value counter_values(Json::objectValue);
+    for(auto & p : counters)
+        counter_values[p.first] = (Json::Int64)p.second;
+    result["counters"] = counter_values;
+
+    Json::Value files(Json::objectValue);
+    long long total_size = 0;
+    struct stat st;
+    for(auto & fn : output_files)
+    {
+        if(stat(fn.c_str(), &st) != 0)
+            continue;
+        files[fn] = (Json::Int64)st.st_size;
+        total_size += st.st_size;
+    }
+    result["files"] = files;
+    result["total_file_size"] = (Json::Int64)total_size;
+
+    ofstream out(param.stats_json, ofstream::binary);
+    if(!out)
+    {
+        cerr << "Warning: cannot open " << param.stats_json << " for writing" << endl;
+        return;
+    }
+    out << result.toStyledString();
+}
+
+void Stats::dump_trace() const
+{
+    /*
+     * Chrome trace event format, can be loaded in chrome://tracing or Perfetto
+     * Only complete events ("X") and thread names are used
+     */
+    Json::Value events(Json::arrayValue);
+
+    for(auto & p : thread_ids)
+    {
+        Json::Value event(Json::objectValue);
+        event["name"] = "thread_name";
+        event["ph"] = "M";
+        event["pid"] = 1;
+        event["tid"] = p.second;
+        event["args"]["name"] = (p.second == 1) ? string("main") : ("worker " + to_string(p.second - 1));
+        events.append(event);
+    }
+
+    for(auto & e : trace_events)
+    {
+        Json::Value event(Json::objectValue);
+        event["name"] = e.name;
+        event["cat"] = "pdf2htmlEX";
+        event["ph"] = "X";
+        event["ts"] = e.ts;
+        event["dur"] = e.dur;
+        event["pid"] = 1;
+        event["tid"] = e.tid;
+        if(e.key >= 0)
+            event["args"]["key"] = (Json::Int64)e.key;
+        events.append(event);
+    }
+
+    Json::Value result(Json::objectValue);
+    result["traceEvents"] = events;
+    result["displayTimeUnit"] = "ms";
+
+    ofstream out(param.trace_file, ofstream::binary);
+    if(!out)
+    {
+        cerr << "Warning: cannot open " << param.trace_file << " for writing" << endl;
+        return;
+    }
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    out << Json::writeString(builder, result);
+}
+
+} // namespace pdf2htmlEX
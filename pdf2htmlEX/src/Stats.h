@@ -0,0 +1,103 @@
+/*
+ * Stats.h
+ *
+ * Collect timings and counters of a conversion, see --stats-json and --trace
+ */
+
+#ifndef STATS_H__
+#define STATS_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+#include "Param.h"
+
+namespace pdf2htmlEX {
+
+class Stats
+{
+public:
+    explicit Stats(const Param & param);
+
+    bool enabled() const { return !(param.stats_json.empty() && param.trace_file.empty()); }
+
+    /*
+     * Add the wall and CPU time of its scope to a phase, and a span to the trace
+     *
+     * key: page number or font id, -1 for phases of the whole document
+     * trace_only: do not add to the timings, for spans in worker threads
+     * Nested phases are counted in both.
+     * May be used in any thread.
+     */
+    class Timer
+    {
+    public:
+        Timer(Stats & stats, const char * phase, long long key = -1, bool trace_only = false);
+        ~Timer();
+
+        // end the current phase and start another one with the same key
+        void next(const char * phase);
+
+    private:
+        void start(void);
+        void finish(void);
+
+        Stats & stats;
+        const char * phase;
+        long long key;
+        bool trace_only;
+        std::chrono::steady_clock::time_point wall_start;
+        std::clock_t cpu_start;
+    };
+
+    void add_count(const std::string & name, long long value);
+    void set_count(const std::string & name, long long value);
+
+    // files in dest_dir, their sizes are read when dumping
+    void add_output_file(const std::string & fn);
+
+    // write to param.stats_json and param.trace_file
+    void dump();
+
+private:
+    void dump_stats() const;
+    void dump_trace() const;
+
+    struct Timing
+    {
+        double wall = 0;
+        double cpu = 0;
+        long long calls = 0;
+    };
+
+    // complete event in Chrome trace event format, times in microseconds
+    struct TraceEvent
+    {
+        const char * name;
+        long long key;
+        double ts, dur;
+        int tid;
+    };
+
+    const Param & param;
+    std::chrono::steady_clock::time_point start_time;
+
+    std::mutex mutex;
+    // phase -> key -> timing
+    std::map<std::string, std::map<long long, Timing>> timings;
+    std::map<std::string, long long> counters;
+    std::set<std::string> output_files;
+    std::vector<TraceEvent> trace_events;
+    // small ids in the order of first appearance, 1 for the main thread
+    std::map<std::thread::id, int> thread_ids;
+};
+
+} // namespace pdf2htmlEX
+
+#endif //STATS_H__
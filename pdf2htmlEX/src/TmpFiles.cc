@@ -25,6 +25,7 @@ namespace pdf2htmlEX {
 
 TmpFiles::TmpFiles( const Param& param )
     : param( param )
+    , keep( false )
 { }
 
 TmpFiles::~TmpFiles()
@@ -58,7 +59,7 @@ double TmpFiles::get_total_size() const
 
 void TmpFiles::clean()
 {
-    if(!param.clean_tmp)
+    if(!param.clean_tmp || keep)
         return;
 
     for(auto & fn : tmp_files)
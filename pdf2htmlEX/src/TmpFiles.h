@@ -15,6 +15,9 @@ public:
 
     void add( const std::string& fn);
     double get_total_size() const;
+    const std::set<std::string>& get_files() const { return tmp_files; }
+    // keep the files in the destructor, e.g. for --resume after a failure
+    void set_keep( bool keep ) { this->keep = keep; }
 
     void dump();
 
@@ -23,6 +26,7 @@ private:
 
     const Param& param;
     std::set<std::string> tmp_files;
+    bool keep;
 };
 
 } // namespace pdf2htmlEX
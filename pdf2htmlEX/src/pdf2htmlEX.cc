@@ -117,6 +117,22 @@ void embed_parser (const char * str)
 
 void prepare_directories()
 {
+    // temporary files are kept for --resume
+    if (!param.checkpoint_dir.empty())
+    {
+        try
+        {
+            create_directories(param.checkpoint_dir);
+        }
+        catch (const string & s)
+        {
+            cerr << s << endl;
+            exit(EXIT_FAILURE);
+        }
+        param.tmp_dir = param.checkpoint_dir;
+        return;
+    }
+
     std::string tmp_dir = param.tmp_dir + "/pdf2htmlEX-XXXXXX";
 
     errno = 0;
@@ -170,6 +186,8 @@ void parse_options (int argc, char **argv)
         .add("printing", &param.printing, 1, "enable printing support")
         .add("fallback", &param.fallback, 0, "output in fallback mode")
         .add("tmp-file-size-limit", &param.tmp_file_size_limit, -1, "Maximum size (in KB) used by temporary files, -1 for no limit")
+        .add("page-cache", &param.page_cache, "", "reuse unchanged pages from the previous conversion recorded in this file, and update it")
+        .add("serve", &param.serve, "", "convert pages on demand, listening on this Unix domain socket")
 
         // fonts
         .add("embed-external-font", &param.embed_external_font, 1, "embed local match for external fonts")
@@ -182,6 +200,7 @@ void parse_options (int argc, char **argv)
         .add("squeeze-wide-glyph", &param.squeeze_wide_glyph, 1, "shrink wide glyphs instead of truncating them")
         .add("override-fstype", &param.override_fstype, 0, "clear the fstype bits in TTF/OTF fonts")
         .add("process-type3", &param.process_type3, 0, "convert Type 3 fonts for web (experimental)")
+        .add("merge-duplicate-fonts", &param.merge_duplicate_fonts, 1, "embed identical font programs only once")
 
         // text
         .add("heps", &param.h_eps, 1.0, "horizontal threshold for merging text, in pixels")
@@ -195,7 +214,20 @@ void parse_options (int argc, char **argv)
         .add("covered-text-dpi", &param.text_dpi, 300, "Rendering DPI to use if correct-text-visibility == 2 and there is partially covered text on the page")
 
         // background image
-        .add("bg-format", &param.bg_format, "png", "specify background image format")
+        .add("bg-format", &param.bg_format, "png", "specify background image format, or \"auto\" to choose per page")
+        .add("bg-tile-size", &param.bg_tile_size, 0, "split bitmap background images into tiles of this size in pixels,"
+                " blank tiles are not dumped; 0 means no tiling")
+        .add("bg-png-mode", &param.bg_png_mode, "rgb", "rgb: true color png background images; palette: indexed color when possible,"
+                " colors may be slightly quantized")
+        .add("bg-png-compression-level", &param.bg_png_compression_level, -1, "zlib compression level (0-9) of png background images; -1 means default")
+        .add("bg-jpeg-passthrough", &param.bg_jpeg_passthrough, 0, "emit jpeg images as they are in separate <img> elements, instead of"
+                " rasterizing them into bitmap background images")
+        .add("bg-srcset-levels", &param.bg_srcset_levels, 0, "also dump bitmap background images at 1/2, 1/4... resolution for srcset,"
+                " up to this many levels")
+        .add("bg-preview-dpi", &param.bg_preview_dpi, 0.0, "resolution of the preview of each page, inlined in the page frame when"
+                " --split-pages is on; 0 means no preview")
+        .add("bg-pixel-budget", &param.bg_pixel_budget, 0.0, "max total megapixels of background images in the document,"
+                " shared by pages not yet rendered, regardless of the size of text in them; 0 means no limit")
         .add("svg-node-count-limit", &param.svg_node_count_limit, -1, "if node count in a svg background image exceeds this limit,"
                 " fall back this page to bitmap background; negative value means no limit")
         .add("svg-embed-bitmap", &param.svg_embed_bitmap, 1, "1: embed bitmaps in svg background; 0: dump bitmaps to external files if possible")
@@ -208,12 +240,17 @@ void parse_options (int argc, char **argv)
         // misc.
         .add("clean-tmp", &param.clean_tmp, 1, "remove temporary files after conversion")
         .add("tmp-dir", &param.tmp_dir, param.tmp_dir, "specify the location of temporary directory")
+        .add("checkpoint-dir", &param.checkpoint_dir, "", "keep temporary files and checkpoints in this directory, such that the conversion can be resumed")
+        .add("checkpoint-interval", &param.checkpoint_interval, 10, "save a checkpoint after every this many pages")
+        .add("resume", &param.resume, 0, "continue from the last checkpoint in --checkpoint-dir")
         .add("data-dir", &param.data_dir, param.data_dir, "specify data directory")
         .add("poppler-data-dir", &param.poppler_data_dir, param.poppler_data_dir, "specify poppler data directory")
         .add("debug", &param.debug, 0, "print debugging information")
         .add("proof", &param.proof, 0, "texts are drawn on both text layer and background for proof")
         .add("quiet", &param.quiet, 0, "perform operations quietly")
         .add("memstat", &param.memstat, 1, "add memstat information to output")
+        .add("stats-json", &param.stats_json, "", "write timings and counters of the conversion to this file in JSON")
+        .add("trace", &param.trace_file, "", "write a timeline of the conversion to this file in Chrome trace event format")
         .add("no_ref", &param.disable_ref, 1, "disable reference output to html file")
         .add("tags", &param.tags, 0, "parse tags (marked content) and save to tags.json file")
 
@@ -370,6 +407,10 @@ void check_param()
 #endif
 #if ENABLE_SVG
     else if(param.bg_format == "svg") { }
+#endif
+#if defined(ENABLE_LIBPNG) || defined(ENABLE_LIBJPEG)
+    // at least one bitmap format is needed, svg is optional
+    else if(param.bg_format == "auto") { }
 #endif
     else
     {
@@ -377,6 +418,25 @@ void check_param()
         exit(EXIT_FAILURE);
     }
 
+    // the preview is made by averaging blocks of at least 2x2 pixels
+    if ((param.bg_preview_dpi > 0) && (param.bg_preview_dpi * 2 > param.desired_dpi))
+    {
+        cerr << "--bg-preview-dpi must be at most half of --dpi." << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (param.embed_image && (param.bg_srcset_levels > 0))
+    {
+        cerr << "Warning: --bg-srcset-levels is ignored because --embed-image is on." << endl;
+        param.bg_srcset_levels = 0;
+    }
+
+    if((param.bg_png_mode != "rgb") && (param.bg_png_mode != "palette"))
+    {
+        cerr << "Unknown png mode: " << param.bg_png_mode << endl;
+        exit(EXIT_FAILURE);
+    }
+
 #if not ENABLE_SVG
     if(param.process_type3)
     {
@@ -390,11 +450,56 @@ void check_param()
         cerr << "Warning: No hint tool is specified for truetype fonts, the result may be rendered poorly in some circumstances." << endl;
     }
 
-    if (param.embed_image && (param.bg_format == "svg") && !param.svg_embed_bitmap)
+    if (param.embed_image && ((param.bg_format == "svg") || (param.bg_format == "auto")) && !param.svg_embed_bitmap)
     {
         cerr << "Warning: --svg-embed-bitmap is forced on because --embed-image is on, or the dumped bitmaps can't be loaded." << endl;
         param.svg_embed_bitmap = 1;
     }
+
+    if (!param.serve.empty())
+    {
+#ifdef __MINGW32__
+        cerr << "--serve is not supported on this platform, Unix domain sockets are not available." << endl;
+        exit(EXIT_FAILURE);
+#endif
+        if (!param.split_pages)
+        {
+            cerr << "Warning: --split-pages is forced on because --serve is set." << endl;
+            param.split_pages = 1;
+        }
+        if (!param.page_cache.empty() || !param.checkpoint_dir.empty() || param.tags)
+        {
+            cerr << "Warning: --page-cache, --checkpoint-dir and --tags are ignored because --serve is set." << endl;
+            param.page_cache = "";
+            param.checkpoint_dir = "";
+            param.resume = 0;
+            param.tags = 0;
+        }
+    }
+
+    if (!param.page_cache.empty() && param.tags)
+    {
+        cerr << "Warning: --page-cache is ignored because --tags is on, cached pages must be self-contained." << endl;
+        param.page_cache = "";
+    }
+
+    if (!param.checkpoint_dir.empty() && param.tags)
+    {
+        cerr << "Warning: --checkpoint-dir is ignored because --tags is on, tags are not saved in checkpoints." << endl;
+        param.checkpoint_dir = "";
+    }
+
+    if (!param.checkpoint_dir.empty() && !param.page_cache.empty())
+    {
+        cerr << "Warning: --page-cache is ignored because --checkpoint-dir is set." << endl;
+        param.page_cache = "";
+    }
+
+    if (param.resume && param.checkpoint_dir.empty())
+    {
+        cerr << "--resume requires --checkpoint-dir." << endl;
+        exit(EXIT_FAILURE);
+    }
 }
 
 int main(int argc, char **argv)
@@ -509,6 +614,7 @@ int main(int argc, char **argv)
         if (param.tags > 0) {
           renderer->dump_tags("tags.json");
         }
+        renderer->dump_stats();
         renderer->dump();
 
         finished = true;
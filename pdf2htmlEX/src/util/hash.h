@@ -0,0 +1,83 @@
+/*
+ * Content hashing
+ *
+ * Used to detect duplicated resources (fonts, images...) in a document
+ */
+
+#ifndef HASH_H__
+#define HASH_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace pdf2htmlEX {
+
+/*
+ * 64-bit FNV-1a
+ *
+ * Not cryptographic, but good enough to tell apart resources of a single document
+ * Data may be fed incrementally, the length of which is also counted
+ */
+class ContentHash
+{
+public:
+    ContentHash() : value(14695981039346656037ULL), length(0) { }
+
+    void update(const void * data, size_t len) {
+        auto p = (const unsigned char *)data;
+        for(size_t i = 0; i < len; ++i)
+        {
+            value ^= p[i];
+            value *= 1099511628211ULL;
+        }
+        length += len;
+    }
+    void update(const std::string & s) { update(s.data(), s.size() + 1); } // including the trailing '\0' as a separator
+
+    uint64_t get(void) const { return value; }
+    // number of bytes fed
+    uint64_t get_length(void) const { return length; }
+
+private:
+    uint64_t value;
+    uint64_t length;
+};
+
+/*
+ * 128-bit FNV-1a
+ *
+ * For keys that are trusted without comparing the data
+ */
+class ContentHash128
+{
+public:
+    ContentHash128()
+        : value((((unsigned __int128)0x6c62272e07bb0142ULL) << 64) | 0x62b821756295c58dULL)
+        , length(0)
+    { }
+
+    void update(const void * data, size_t len) {
+        const unsigned __int128 prime = (((unsigned __int128)1) << 88) | 0x13b;
+        auto p = (const unsigned char *)data;
+        for(size_t i = 0; i < len; ++i)
+        {
+            value ^= p[i];
+            value *= prime;
+        }
+        length += len;
+    }
+    void update(const std::string & s) { update(s.data(), s.size() + 1); }
+
+    uint64_t get_high(void) const { return (uint64_t)(value >> 64); }
+    uint64_t get_low(void) const { return (uint64_t)value; }
+    uint64_t get_length(void) const { return length; }
+
+private:
+    unsigned __int128 value;
+    uint64_t length;
+};
+
+} //namespace pdf2htmlEX
+
+#endif //HASH_H__
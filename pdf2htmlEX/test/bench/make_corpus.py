@@ -0,0 +1,258 @@
+#!/usr/bin/env python
+
+# Generate the synthetic corpus for the macro benchmarks
+#
+# The documents are generated deterministically, such that results of
+# different builds are comparable. Each document stresses one part of
+# pdf2htmlEX:
+#
+#   text_dense   : many lines of text in standard fonts
+#   vector_dense : many paths, some of them covering text
+#   image_heavy  : large images in each page
+#   cjk          : CJK text in a non-embedded CID font
+#   type3        : text in a Type 3 font
+
+import os
+import json
+import zlib
+import random
+import argparse
+
+PAGE_WIDTH = 612
+PAGE_HEIGHT = 792
+
+
+class PDFWriter(object):
+    """
+    Minimal PDF writer, objects are numbered from 1 in the order they are added.
+    """
+    def __init__(self):
+        self.objects = []
+
+    def reserve(self):
+        self.objects.append(None)
+        return len(self.objects)
+
+    def set(self, num, body):
+        self.objects[num - 1] = body
+
+    def add(self, body):
+        num = self.reserve()
+        self.set(num, body)
+        return num
+
+    def add_stream(self, data, extra_dict='', compress=True):
+        if compress:
+            data = zlib.compress(data)
+            extra_dict += ' /Filter /FlateDecode'
+        return self.add(b'<< /Length %d%s >>\nstream\n' % (len(data), extra_dict.encode('ascii'))
+                        + data + b'\nendstream')
+
+    def write(self, filename, root):
+        out = bytearray(b'%PDF-1.4\n%\xe2\xe3\xcf\xd3\n')
+        offsets = []
+        for i, body in enumerate(self.objects):
+            if isinstance(body, str):
+                body = body.encode('ascii')
+            offsets.append(len(out))
+            out += b'%d 0 obj\n' % (i + 1) + body + b'\nendobj\n'
+        xref = len(out)
+        out += b'xref\n0 %d\n' % (len(self.objects) + 1)
+        out += b'0000000000 65535 f \n'
+        for offset in offsets:
+            out += b'%010d 00000 n \n' % offset
+        out += b'trailer\n<< /Size %d /Root %d 0 R >>\nstartxref\n%d\n%%%%EOF\n' % (len(self.objects) + 1, root, xref)
+        with open(filename, 'wb') as f:
+            f.write(out)
+
+
+def build_document(filename, page_count, resources, page_content):
+    """
+    resources: function(writer) -> resource dictionary string
+    page_content: function(writer, page_index) -> (content stream bytes, extra resources string)
+    """
+    w = PDFWriter()
+    catalog = w.reserve()
+    pages = w.reserve()
+    res = resources(w)
+    kids = []
+    for i in range(page_count):
+        content, xobjects = page_content(w, i)
+        content_num = w.add_stream(content)
+        page_res = res
+        if xobjects:
+            page_res = res[:-2] + ' /XObject << ' + xobjects + ' >> >>'
+        kids.append(w.add('<< /Type /Page /Parent %d 0 R /MediaBox [0 0 %d %d] /Resources %s /Contents %d 0 R >>'
+                          % (pages, PAGE_WIDTH, PAGE_HEIGHT, page_res, content_num)))
+    w.set(pages, '<< /Type /Pages /Kids [%s] /Count %d >>' % (' '.join('%d 0 R' % k for k in kids), len(kids)))
+    w.set(catalog, '<< /Type /Catalog /Pages %d 0 R >>' % pages)
+    w.write(filename, catalog)
+
+
+WORDS = ('lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor '
+         'incididunt ut labore et dolore magna aliqua enim ad minim veniam quis nostrud').split()
+
+
+def pdf_string(s):
+    return '(' + s.replace('\\', '\\\\').replace('(', '\\(').replace(')', '\\)') + ')'
+
+
+def random_line(rng, length):
+    words = []
+    while sum(len(x) + 1 for x in words) < length:
+        words.append(rng.choice(WORDS))
+    return ' '.join(words)
+
+
+def standard_fonts(w):
+    f1 = w.add('<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica /Encoding /WinAnsiEncoding >>')
+    f2 = w.add('<< /Type /Font /Subtype /Type1 /BaseFont /Times-Roman /Encoding /WinAnsiEncoding >>')
+    return '<< /Font << /F1 %d 0 R /F2 %d 0 R >> >>' % (f1, f2)
+
+
+def text_dense(w, i, rng):
+    ops = []
+    y = PAGE_HEIGHT - 40
+    while y > 40:
+        size = rng.choice([8, 9, 10, 11])
+        ops.append('BT /F%d %d Tf %.3f %.3f %.3f rg 36 %d Td %.2f Tc %s Tj ET'
+                   % (rng.choice([1, 2]), size, rng.random() * 0.3, rng.random() * 0.3, rng.random() * 0.3,
+                      y, rng.random() * 0.3, pdf_string(random_line(rng, 100))))
+        y -= size + 3
+    return '\n'.join(ops).encode('ascii'), ''
+
+
+def vector_dense(w, i, rng):
+    ops = []
+    # text first, so that some of it is covered by the paths
+    for y in range(PAGE_HEIGHT - 60, 40, -40):
+        ops.append('BT /F1 12 Tf 0 0 0 rg 36 %d Td %s Tj ET' % (y, pdf_string(random_line(rng, 80))))
+    for _ in range(2000):
+        x, y = rng.uniform(0, PAGE_WIDTH), rng.uniform(0, PAGE_HEIGHT)
+        ops.append('%.3f %.3f %.3f rg %.3f %.3f %.3f RG' % tuple(rng.random() for _ in range(6)))
+        if rng.random() < 0.5:
+            ops.append('%.2f %.2f %.2f %.2f re f' % (x, y, rng.uniform(1, 20), rng.uniform(1, 20)))
+        else:
+            ops.append('%.2f w %.2f %.2f m %.2f %.2f %.2f %.2f %.2f %.2f c S'
+                       % (rng.uniform(0.1, 2), x, y,
+                          x + rng.uniform(-30, 30), y + rng.uniform(-30, 30),
+                          x + rng.uniform(-30, 30), y + rng.uniform(-30, 30),
+                          x + rng.uniform(-30, 30), y + rng.uniform(-30, 30)))
+    return '\n'.join(ops).encode('ascii'), ''
+
+
+def image_heavy(w, i, rng):
+    ops = []
+    xobjects = []
+    size = 384
+    for n in range(4):
+        # smooth gradient with noise, hard to compress
+        data = bytearray()
+        seed = rng.randrange(256)
+        for y in range(size):
+            for x in range(size):
+                noise = rng.randrange(32)
+                data += bytes(((x + seed) & 0xff, (y + noise) & 0xff, ((x ^ y) + seed) & 0xff))
+        img = w.add_stream(bytes(data), ' /Type /XObject /Subtype /Image /Width %d /Height %d'
+                           ' /ColorSpace /DeviceRGB /BitsPerComponent 8' % (size, size))
+        xobjects.append('/Im%d %d 0 R' % (n, img))
+        ops.append('q 270 0 0 350 %d %d cm /Im%d Do Q' % (36 + (n % 2) * 276, 40 + (n // 2) * 370, n))
+    ops.append('BT /F1 10 Tf 0 0 0 rg 36 20 Td %s Tj ET' % pdf_string('Page %d' % (i + 1)))
+    return '\n'.join(ops).encode('ascii'), ' '.join(xobjects)
+
+
+def cjk_fonts(w):
+    cid = w.add('<< /Type /Font /Subtype /CIDFontType0 /BaseFont /STSong-Light'
+                ' /CIDSystemInfo << /Registry (Adobe) /Ordering (GB1) /Supplement 2 >>'
+                ' /FontDescriptor << /Type /FontDescriptor /FontName /STSong-Light /Flags 6'
+                ' /FontBBox [-25 -254 1000 880] /ItalicAngle 0 /Ascent 880 /Descent -120'
+                ' /CapHeight 880 /StemV 93 >> /DW 1000 >>')
+    f1 = w.add('<< /Type /Font /Subtype /Type0 /BaseFont /STSong-Light /Encoding /UniGB-UCS2-H'
+               ' /DescendantFonts [%d 0 R] >>' % cid)
+    return '<< /Font << /F1 %d 0 R >> >>' % f1
+
+
+def cjk(w, i, rng):
+    ops = []
+    y = PAGE_HEIGHT - 50
+    while y > 40:
+        # common CJK ideographs
+        text = ''.join('%04X' % rng.randrange(0x4e00, 0x5400) for _ in range(36))
+        ops.append('BT /F1 14 Tf 36 %d Td <%s> Tj ET' % (y, text))
+        y -= 20
+    return '\n'.join(ops).encode('ascii'), ''
+
+
+TYPE3_GLYPHS = 'abcdefghijklmnopqrstuvwxyz'
+
+
+def type3_fonts(w):
+    procs = []
+    for n, c in enumerate(TYPE3_GLYPHS):
+        rng = random.Random(n)
+        # a few random strokes in a 1000x1000 glyph box
+        ops = ['600 0 0 0 600 1000 d1']
+        for _ in range(4):
+            ops.append('40 w %d %d m %d %d l S' % (rng.randrange(50, 550), rng.randrange(0, 900),
+                                                  rng.randrange(50, 550), rng.randrange(0, 900)))
+        ops.append('%d %d %d %d re f' % (100, 0, 400, 100 + 30 * n))
+        procs.append('/%s %d 0 R' % (c, w.add_stream('\n'.join(ops).encode('ascii'))))
+    tounicode = ['/CIDInit /ProcSet findresource begin 12 dict begin begincmap',
+                 '/CMapName /T3 def /CMapType 2 def',
+                 '1 begincodespacerange <00> <FF> endcodespacerange',
+                 '%d beginbfchar' % len(TYPE3_GLYPHS)]
+    for c in TYPE3_GLYPHS:
+        tounicode.append('<%02X> <%04X>' % (ord(c), ord(c)))
+    tounicode += ['endbfchar', 'endcmap CMapName currentdict /CMap defineresource pop end end']
+    cmap = w.add_stream('\n'.join(tounicode).encode('ascii'))
+    f1 = w.add('<< /Type /Font /Subtype /Type3 /FontBBox [0 0 600 1000] /FontMatrix [0.001 0 0 0.001 0 0]'
+               ' /CharProcs << %s >> /Encoding << /Type /Encoding /Differences [%d %s] >>'
+               ' /FirstChar %d /LastChar %d /Widths [%s] /ToUnicode %d 0 R /Resources << >> >>'
+               % (' '.join(procs), ord(TYPE3_GLYPHS[0]), ' '.join('/' + c for c in TYPE3_GLYPHS),
+                  ord(TYPE3_GLYPHS[0]), ord(TYPE3_GLYPHS[-1]), ' '.join(['600'] * len(TYPE3_GLYPHS)), cmap))
+    return '<< /Font << /F1 %d 0 R >> >>' % f1
+
+
+def type3(w, i, rng):
+    ops = []
+    y = PAGE_HEIGHT - 50
+    while y > 40:
+        text = ''.join(rng.choice(TYPE3_GLYPHS) for _ in range(60))
+        ops.append('BT /F1 12 Tf 36 %d Td %s Tj ET' % (y, pdf_string(text)))
+        y -= 16
+    return '\n'.join(ops).encode('ascii'), ''
+
+
+DOCUMENTS = {
+    'text_dense':   (standard_fonts, text_dense),
+    'vector_dense': (standard_fonts, vector_dense),
+    'image_heavy':  (standard_fonts, image_heavy),
+    'cjk':          (cjk_fonts, cjk),
+    'type3':        (type3_fonts, type3),
+}
+
+
+def make_corpus(output_dir, page_count):
+    """
+    Generate all documents into output_dir, return {name: {'file': ..., 'pages': ...}}
+    """
+    if not os.path.isdir(output_dir):
+        os.makedirs(output_dir)
+    corpus = {}
+    for name, (resources, content) in sorted(DOCUMENTS.items()):
+        rng = random.Random(name)
+        filename = os.path.join(output_dir, name + '.pdf')
+        build_document(filename, page_count, resources, lambda w, i: content(w, i, rng))
+        corpus[name] = {'file': filename, 'pages': page_count}
+    with open(os.path.join(output_dir, 'corpus.json'), 'w') as f:
+        json.dump(corpus, f, indent=2, sort_keys=True)
+    return corpus
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Generate the synthetic corpus for benchmarks')
+    parser.add_argument('output_dir')
+    parser.add_argument('--pages', type=int, default=10, help='number of pages of each document')
+    args = parser.parse_args()
+    for name, info in sorted(make_corpus(args.output_dir, args.pages).items()):
+        print('%s: %d pages, %d bytes' % (info['file'], info['pages'], os.path.getsize(info['file'])))
@@ -0,0 +1,273 @@
+/*
+ * Micro benchmarks of hot paths in pdf2htmlEX
+ *
+ * Usage: pdf2htmlEX_microbench [result.json]
+ *
+ * Each benchmark is repeated until it has run for a while,
+ * the time per run and the throughput are reported.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <memory>
+
+#include <cairo.h>
+#include <jsoncpp/json/json.h>
+
+#include "Param.h"
+#include "Base64Stream.h"
+#include "StateManager.h"
+#include "CoveredTextDetector.h"
+#include "HTMLTextLine.h"
+#include "util/encoding.h"
+#include "util/const.h"
+
+using namespace std;
+using namespace pdf2htmlEX;
+
+static Json::Value results(Json::objectValue);
+
+/*
+ * setup is not timed, run is timed
+ * items: number of items processed by each run, e.g. bytes or glyphs
+ */
+static void bench(const char * name, long long items, const char * unit,
+        function<void()> setup, function<void()> run)
+{
+    const double min_time = 0.5;
+    const int min_runs = 5;
+
+    double total = 0;
+    int runs = 0;
+    while((total < min_time) || (runs < min_runs))
+    {
+        setup();
+        auto start = chrono::steady_clock::now();
+        run();
+        total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        ++runs;
+    }
+
+    double per_run = total / runs;
+    double throughput = items / per_run;
+    cout << name << ": " << (per_run * 1e6) << " us/run, "
+         << throughput << " " << unit << "/s" << endl;
+
+    Json::Value r(Json::objectValue);
+    r["runs"] = runs;
+    r["seconds_per_run"] = per_run;
+    r["items_per_run"] = (Json::Int64)items;
+    r["unit"] = unit;
+    r["throughput"] = throughput;
+    results[name] = r;
+}
+
+static void bench_base64(void)
+{
+    string data(1 << 20, '\0');
+    mt19937 rng(1);
+    for(auto & c : data)
+        c = (char)(rng() & 0xff);
+
+    ostringstream out;
+    bench("base64_stream", data.size(), "bytes",
+        [&]{ out.str(""); },
+        [&]{ out << Base64Stream(data); });
+}
+
+static void bench_write_unicodes(void)
+{
+    // ascii, chars to be escaped, latin and CJK
+    vector<Unicode> text;
+    const Unicode samples[] = { 'a', 'b', ' ', '<', '&', '"', 0xe9, 0x4e2d, 0x6587, 0x1f600 };
+    mt19937 rng(2);
+    for(int i = 0; i < (1 << 16); ++i)
+        text.push_back(samples[rng() % (sizeof(samples) / sizeof(samples[0]))]);
+
+    ostringstream out;
+    bench("write_unicodes", text.size(), "chars",
+        [&]{ out.str(""); },
+        [&]{ writeUnicodes(out, text.data(), text.size()); });
+}
+
+static void bench_state_manager(void)
+{
+    // values are often repeated in real documents
+    vector<double> values;
+    mt19937 rng(3);
+    for(int i = 0; i < 100000; ++i)
+        values.push_back((rng() % 2000) * 0.01);
+
+    // state managers keep a pointer to themselves, do not copy them
+    unique_ptr<FontSizeManager> font_size;
+    bench("state_manager_install", values.size(), "values",
+        [&]{
+            font_size.reset(new FontSizeManager());
+            font_size->set_eps(0.001);
+        },
+        [&]{
+            for(auto v : values)
+                font_size->install(v);
+        });
+}
+
+static void bench_covered_text_detector(void)
+{
+    Param param = Param();
+    param.correct_text_visibility = 1;
+    CoveredTextDetector detector(param);
+
+    auto surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 612, 792);
+    auto cairo = cairo_create(surface);
+
+    // a page of text, 50 lines * 80 chars
+    const int chars = 50 * 80;
+    const int shapes = 200;
+    mt19937 rng(4);
+    bench("covered_text_detector", (long long)chars * shapes, "char*shape tests",
+        [&]{
+            detector.reset();
+            for(int i = 0; i < chars; ++i)
+            {
+                double x = 36 + (i % 80) * 6.75, y = 36 + (i / 80) * 14.4;
+                double bbox[4] = { x, y, x + 6, y + 10 };
+                detector.add_char_bbox(cairo, bbox);
+            }
+        },
+        [&]{
+            for(int i = 0; i < shapes; ++i)
+            {
+                double x = rng() % 600, y = rng() % 780;
+                double bbox[4] = { x, y, x + 12, y + 12 };
+                cairo_new_path(cairo);
+                cairo_rectangle(cairo, x, y, 12, 12);
+                detector.add_non_char_bbox(cairo, bbox, 1);
+            }
+        });
+
+    cairo_destroy(cairo);
+    cairo_surface_destroy(surface);
+}
+
+/*
+ * A line of text with frequent offsets and state changes,
+ * similar to text justified by the PDF producer
+ */
+static void bench_text_line(void)
+{
+    Param param = Param();
+    param.h_eps = 1.0;
+    param.v_eps = 1.0;
+    param.space_threshold = 1.0 / 8;
+    param.optimize_text = 1;
+    param.zoom = 1;
+
+    AllStateManager all_manager;
+    all_manager.transform_matrix.install(ID_MATRIX);
+
+    FontInfo font_info = FontInfo();
+    font_info.id = 0;
+    font_info.use_tounicode = true;
+    font_info.em_size = 1000;
+    font_info.space_width = 0.25;
+    font_info.ascent = 0.8;
+    font_info.descent = -0.2;
+    font_info.font_size_scale = 1;
+
+    HTMLLineState line_state;
+    line_state.x = 36;
+    line_state.y = 700;
+    for(int i = 0; i < 4; ++i)
+        line_state.transform_matrix[i] = ID_MATRIX[i];
+    line_state.first_char_index = 0;
+    line_state.is_char_covered = [](int) { return false; };
+
+    const int glyphs = 4000;
+    vector<HTMLTextLine*> lines;
+
+    auto build = [&]{
+        for(auto p : lines)
+            delete p;
+        lines.clear();
+
+        auto line = new HTMLTextLine(line_state, param, all_manager);
+        mt19937 rng(5);
+        HTMLTextState state;
+        state.font_info = &font_info;
+        state.fill_color = Color(0, 0, 0);
+        state.stroke_color = Color(0, 0, 0, true);
+        state.vertical_align = 0;
+        for(int i = 0; i < glyphs; ++i)
+        {
+            if(i % 200 == 0)
+            {
+                state.font_size = (i % 400 == 0) ? 10 : 12;
+                state.letter_space = (rng() % 3) * 0.1;
+                state.word_space = 0;
+                line->append_state(state);
+            }
+            Unicode u = (i % 6 == 5) ? ' ' : ('a' + rng() % 26);
+            line->append_unicodes(&u, 1, 5.5);
+            if(i % 6 == 5)
+                line->append_offset(0.3 + (rng() % 10) * 0.05);
+        }
+        return line;
+    };
+
+    bench("text_line_optimize_normal", glyphs, "glyphs",
+        [&]{ lines.push_back(build()); },
+        [&]{
+            vector<HTMLTextLine*> new_lines;
+            for(auto p : lines)
+                p->optimize(new_lines);
+            lines.swap(new_lines);
+        });
+
+    ostringstream out;
+    bench("text_line_dump_text", glyphs, "glyphs",
+        [&]{
+            out.str("");
+            lines.push_back(build());
+            vector<HTMLTextLine*> new_lines;
+            for(auto p : lines)
+                p->optimize(new_lines);
+            lines.swap(new_lines);
+            for(auto p : lines)
+                p->prepare();
+        },
+        [&]{
+            for(auto p : lines)
+                p->dump_text(out, nullptr, 1, nullptr);
+        });
+
+    for(auto p : lines)
+        delete p;
+}
+
+int main(int argc, char **argv)
+{
+    bench_base64();
+    bench_write_unicodes();
+    bench_state_manager();
+    bench_covered_text_detector();
+    bench_text_line();
+
+    if(argc > 1)
+    {
+        ofstream out(argv[1]);
+        if(!out)
+        {
+            cerr << "Cannot open " << argv[1] << " for writing" << endl;
+            return 1;
+        }
+        out << results.toStyledString();
+    }
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#!/usr/bin/env python
+
+# Macro benchmarks: convert the synthetic corpus (see make_corpus.py)
+# and report the throughput of each document.
+#
+# Results are stored as JSON, pass a previous result with --compare
+# to see the changes.
+
+import os
+import sys
+import json
+import time
+import shutil
+import argparse
+import tempfile
+import subprocess
+
+from make_corpus import make_corpus
+
+SRC_DIR = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+DATA_DIR = os.path.join(SRC_DIR, 'share')
+
+
+def dir_size(path):
+    total = 0
+    for root, dirs, files in os.walk(path):
+        for f in files:
+            total += os.path.getsize(os.path.join(root, f))
+    return total
+
+
+def run_document(pdf2htmlEX, info, work_dir, repeat, extra_args):
+    """
+    Convert a document `repeat` times, the fastest run is reported
+    """
+    best = None
+    stats = None
+    for _ in range(repeat):
+        dest_dir = os.path.join(work_dir, 'out')
+        shutil.rmtree(dest_dir, ignore_errors=True)
+        os.mkdir(dest_dir)
+        stats_file = os.path.join(work_dir, 'stats.json')
+
+        args = pdf2htmlEX.split() + ['--data-dir', DATA_DIR, '--dest-dir', dest_dir,
+                                     '--stats-json', stats_file] + extra_args + [info['file']]
+        start = time.time()
+        with open(os.devnull, 'w') as fnull:
+            return_code = subprocess.call(args, stdout=fnull, stderr=fnull)
+        seconds = time.time() - start
+        if return_code != 0:
+            raise Exception('pdf2htmlEX failed on %s' % info['file'])
+
+        if (best is None) or (seconds < best):
+            best = seconds
+            output_bytes = dir_size(dest_dir)
+            if os.path.isfile(stats_file):
+                with open(stats_file) as f:
+                    stats = json.load(f)
+
+    input_bytes = os.path.getsize(info['file'])
+    result = {
+        'pages': info['pages'],
+        'seconds': best,
+        'input_bytes': input_bytes,
+        'output_bytes': output_bytes,
+        'pages_per_second': info['pages'] / best,
+        'input_mb_per_second': input_bytes / best / 1e6,
+        'output_mb_per_second': output_bytes / best / 1e6,
+    }
+    if stats:
+        result['phases'] = dict((k, v['wall']) for k, v in stats['phases'].items())
+    return result
+
+
+def compare(results, baseline):
+    print('')
+    print('%-16s %12s %12s %8s' % ('document', 'pages/s', 'baseline', 'change'))
+    for name, r in sorted(results['documents'].items()):
+        b = baseline.get('documents', {}).get(name)
+        if not b:
+            continue
+        change = r['pages_per_second'] / b['pages_per_second'] - 1
+        print('%-16s %12.2f %12.2f %+7.1f%%' % (name, r['pages_per_second'], b['pages_per_second'], change * 100))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Run the macro benchmarks of pdf2htmlEX')
+    parser.add_argument('--pdf2htmlEX', default='pdf2htmlEX', help='command to run pdf2htmlEX')
+    parser.add_argument('--output', help='write results to this JSON file')
+    parser.add_argument('--compare', help='compare with results in this JSON file')
+    parser.add_argument('--pages', type=int, default=10, help='number of pages of each document')
+    parser.add_argument('--repeat', type=int, default=3, help='number of runs of each document')
+    parser.add_argument('--only', action='append', help='only run the given documents')
+    parser.add_argument('extra_args', nargs='*', help='extra arguments passed to pdf2htmlEX, after --')
+    args = parser.parse_args()
+
+    work_dir = tempfile.mkdtemp(prefix='pdf2htmlEX_bench')
+    try:
+        corpus = make_corpus(os.path.join(work_dir, 'corpus'), args.pages)
+        results = {
+            'pdf2htmlEX': args.pdf2htmlEX,
+            'extra_args': args.extra_args,
+            'repeat': args.repeat,
+            'documents': {},
+        }
+        for name, info in sorted(corpus.items()):
+            if args.only and name not in args.only:
+                continue
+            r = run_document(args.pdf2htmlEX, info, work_dir, args.repeat, args.extra_args)
+            results['documents'][name] = r
+            print('%-16s %8.2f pages/s %8.2f MB/s in %8.2f MB/s out'
+                  % (name, r['pages_per_second'], r['input_mb_per_second'], r['output_mb_per_second']))
+    finally:
+        shutil.rmtree(work_dir, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    if args.compare:
+        with open(args.compare) as f:
+            compare(results, json.load(f))
@@ -29,6 +29,14 @@ class BrowserTests(Common):
     def tearDownClass(cls):
         pass
 
+    def wait_for_images(self, timeout=5):
+        # pages are shown by the viewer after loading, and their background images are lazily loaded
+        from selenium.webdriver.support.ui import WebDriverWait
+        WebDriverWait(self.browser, timeout).until(lambda browser: browser.execute_script(
+            "return (document.readyState === 'complete')"
+            " && Array.prototype.every.call(document.images, function(img) {"
+            "      return img.complete || (img.offsetParent === null); });"))
+
     def run_test_case(self, filename, args=[], page_must_load=True):
         basefilename, extension = os.path.splitext(filename)
         self.assertEqual(extension.lower(), '.pdf', 'Input file is not PDF')
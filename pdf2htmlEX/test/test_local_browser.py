@@ -36,6 +36,7 @@ class test_local_browser(BrowserTests, unittest.TestCase):
              self.browser.get('file://' + html_file)
              WebDriverWait(self.browser, 5) \
              .until(expected_conditions.presence_of_element_located((By.ID, 'page-container')))
+             self.wait_for_images()
          except WebDriverException as e:
              if page_must_load:
                  raise e
@@ -114,6 +114,7 @@ class test_remote_browser_base(BrowserTests):
         self.browser.get(BASEURL + html_file)
         try:
             WebDriverWait(self.browser, 5).until(expected_conditions.presence_of_element_located((By.ID, 'page-container')))
+            self.wait_for_images()
         except:
             if page_must_load:
                 raise